@@ -0,0 +1,489 @@
+/* This module parses raw MIDI captures, files containing the bytes exactly as
+ * they were received. This is nothing Atari specific.
+ *
+ * How to use: midicap_map loads a capture (it is memory mapped where the
+ * system can do it), then midicap_parse_all parses it into a list of
+ * messages, using up to n chunks parsed in parallel. The list is the same
+ * whatever n is, and the same as a parse of the whole capture in one go
+ * with midicap_parse. Each message has the position of its first byte as
+ * timestamp, a sysex has the position after its last byte so its data can be
+ * read back from the capture (skipping realtime bytes).
+ *
+ * How it works: the state of the parser (see midiparse.c) at any place only
+ * depends on the last status byte before it and on the number of data
+ * bytes since. midicap_split cuts the capture into chunks of about the same
+ * size, looks back from each cut for the last status byte (or up to the
+ * start of the previous chunk, whose state is known) and moves the cut to
+ * the end of the message being received. A parser starting there with the
+ * running status found is in the same state a parser coming from the start
+ * would be, even in a long stretch of running status. A cut in a sysex is
+ * moved to the next status byte, where the state doesn't depend on what
+ * came before, so a capture which is one big sysex is parsed by one chunk.
+ * Each chunk is parsed by its own parser, which stops where the next chunk
+ * starts: messages and sysex crossing the place where the capture was cut
+ * are parsed whole by the chunk where they begin. midicap_finish then does
+ * what the status byte starting the next chunk, if it's one, does to the
+ * message pending (a sysex is terminated, anything else is aborted). Then
+ * each chunk copies its list to its place in the whole list.
+ * On TOS the chunks are done one after the other, elsewhere each one has its
+ * own thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "midicap.h"
+
+#ifndef __TOS__
+#include <pthread.h>
+#endif
+
+/* What a chunk has to parse, and what it found */
+typedef struct {
+    const UBYTE *data;
+    ULONG from;
+    ULONG to;
+    int more;
+    MIDICAP_PARSER parser;
+    MIDICAP_LIST list;
+    int result;
+    MIDICAP_MSG *dest;	/* Where its messages go in the whole list */
+} CHUNK;
+
+static int add(MIDICAP_LIST *list, MIDICAP_MSG *msg);
+static int add_error(MIDICAP_LIST *list, ULONG offset, UBYTE code);
+static int cut(MIDICAP_PARSER *p, short flags, ULONG offset, MIDICAP_LIST *out);
+static ULONG resync(const UBYTE *data, ULONG length, ULONG from, ULONG pos,
+		    MIDICAP_PARSER *p);
+static void parse_chunk(CHUNK *chunk);
+static void copy_chunk(CHUNK *chunk);
+static void run(CHUNK *chunks, short count, void (*function)(CHUNK *));
+
+
+void midicap_list_init(MIDICAP_LIST *list)
+{
+    list->msgs = NULL;
+    list->count = list->size = 0;
+}
+
+void midicap_list_free(MIDICAP_LIST *list)
+{
+    free(list->msgs);
+    midicap_list_init(list);
+}
+
+void midicap_parser_init(MIDICAP_PARSER *p)
+{
+    midiparse_init(&p->parser);
+}
+
+/* Parses the bytes from 'from' to 'to' (excluded) and adds the messages found
+ * to 'out'. Returns 0, or -1 if there's not enough memory. */
+int midicap_parse(MIDICAP_PARSER *p, const UBYTE *data, ULONG from, ULONG to,
+		  MIDICAP_LIST *out)
+{
+    MIDICAP_MSG rt;
+    ULONG i;
+    UBYTE byte;
+    short flags;
+
+    for (i = from; i < to; i++)
+    {
+	byte = data[i];
+	flags = midiparse_byte(&p->parser, byte);
+
+	if (flags & MIDIPARSE_REALTIME) /* May come in the middle of others */
+	{
+	    rt.offset = rt.end = i;
+	    rt.status = byte;
+	    rt.data1 = rt.data2 = 0;
+	    if (add(out, &rt))
+		return -1;
+	    continue;
+	}
+	if (flags & MIDIPARSE_ERROR)
+	{
+	    if (add_error(out, i, MIDIMSG_UNEXPECTED_DATA))
+		return -1;
+	    continue;
+	}
+	if (cut(p, flags, i, out))
+	    return -1;
+
+	if (flags & MIDIPARSE_BEGIN)
+	{
+	    p->msg.offset = p->msg.end = i;
+	    p->msg.status = p->parser.status;
+	    p->msg.data1 = p->msg.data2 = 0;
+	}
+	if (byte < 0x80 && p->parser.expected >= 0) /* Not sysex data */
+	{
+	    if (p->parser.expected == midiparse_data_length(p->msg.status) - 1)
+		p->msg.data1 = byte;
+	    else
+		p->msg.data2 = byte;
+	}
+	if (flags & MIDIPARSE_END)
+	{
+	    if (byte == 0xF7)
+		p->msg.end = i + 1;
+	    if (add(out, &p->msg))
+		return -1;
+	}
+    }
+    return 0;
+}
+
+/* The parser reached 'offset', where the next chunk starts if 'more' is set.
+ * If there's a status byte there, does what it does to the message being
+ * received. A message still incomplete at the end of the capture is left
+ * out. */
+int midicap_finish(MIDICAP_PARSER *p, ULONG offset, int more, MIDICAP_LIST *out)
+{
+    if (more)
+	return cut(p, midiparse_cut(&p->parser), offset, out);
+    return 0;
+}
+
+/* Cuts the capture into at most n chunks, puts where each one starts in
+ * 'starts' and the state of a parser coming from the start of the capture
+ * there in 'parsers'. Returns the number of chunks. */
+short midicap_split(const UBYTE *data, ULONG length, short n, ULONG *starts,
+		    MIDICAP_PARSER *parsers)
+{
+    ULONG size, pos;
+    short i, count;
+
+    if (n < 1)
+	n = 1;
+    if (n > MIDICAP_MAX_CHUNKS)
+	n = MIDICAP_MAX_CHUNKS;
+    size = length / n;
+
+    starts[0] = 0;
+    midicap_parser_init(&parsers[0]);
+    count = 1;
+    for (i = 1; i < n && size; i++)
+    {
+	pos = i * size;
+	if (pos <= starts[count - 1])
+	    pos = starts[count - 1] + 1;
+	parsers[count] = parsers[count - 1];
+	pos = resync(data, length, starts[count - 1], pos, &parsers[count]);
+	if (pos >= length) /* The previous chunk parses the rest */
+	    break;
+	starts[count++] = pos;
+    }
+    return count;
+}
+
+/* Parses a whole capture with up to n chunks in parallel. Returns 0, or -1 if
+ * there's not enough memory (then 'out' is empty). */
+int midicap_parse_all(const UBYTE *data, ULONG length, short n, MIDICAP_LIST *out)
+{
+    ULONG starts[MIDICAP_MAX_CHUNKS];
+    MIDICAP_PARSER parsers[MIDICAP_MAX_CHUNKS];
+    CHUNK *chunks;
+    ULONG total;
+    short count, i;
+    int result = 0;
+
+    midicap_list_init(out);
+    count = midicap_split(data, length, n, starts, parsers);
+    chunks = malloc(count * sizeof(CHUNK));
+    if (chunks == NULL)
+	return -1;
+
+    for (i = 0; i < count; i++)
+    {
+	chunks[i].data = data;
+	chunks[i].from = starts[i];
+	chunks[i].more = i + 1 < count;
+	chunks[i].to = chunks[i].more ? starts[i + 1] : length;
+	chunks[i].parser = parsers[i];
+	midicap_list_init(&chunks[i].list);
+    }
+    run(chunks, count, parse_chunk);
+
+    total = 0;
+    for (i = 0; i < count; i++)
+    {
+	if (chunks[i].result)
+	    result = -1;
+	total += chunks[i].list.count;
+    }
+    if (!result && count == 1) /* Nothing to stitch */
+    {
+	*out = chunks[0].list;
+	free(chunks);
+	return 0;
+    }
+
+    /* Stitch the lists together, each chunk copies its own to its place */
+    if (!result && total)
+    {
+	out->msgs = malloc(total * sizeof(MIDICAP_MSG));
+	if (out->msgs == NULL)
+	    result = -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+	chunks[i].dest = result ? NULL : &out->msgs[out->count];
+	out->count += chunks[i].list.count;
+    }
+    run(chunks, count, copy_chunk);
+    if (result)
+	out->count = 0;
+    out->size = out->count;
+    free(chunks);
+    return result;
+}
+
+
+static int add(MIDICAP_LIST *list, MIDICAP_MSG *msg)
+{
+    MIDICAP_MSG *msgs;
+    ULONG size;
+
+    if (list->count == list->size)
+    {
+	size = list->size ? list->size * 2 : 1024;
+	msgs = realloc(list->msgs, size * sizeof(MIDICAP_MSG));
+	if (msgs == NULL)
+	    return -1;
+	list->msgs = msgs;
+	list->size = size;
+    }
+    list->msgs[list->count++] = *msg;
+    return 0;
+}
+
+static int add_error(MIDICAP_LIST *list, ULONG offset, UBYTE code)
+{
+    MIDICAP_MSG msg;
+
+    msg.offset = msg.end = offset;
+    msg.status = 0;
+    msg.data1 = code;
+    msg.data2 = 0;
+    return add(list, &msg);
+}
+
+/* A status byte at 'offset' cut the message being received ('flags' from
+ * midiparse). A sysex is terminated, other messages are lost. */
+static int cut(MIDICAP_PARSER *p, short flags, ULONG offset, MIDICAP_LIST *out)
+{
+    if (flags & MIDIPARSE_SYSEX_CUT)
+    {
+	p->msg.end = offset;
+	return add(out, &p->msg);
+    }
+    if (flags & MIDIPARSE_ABORTED)
+	return add_error(out, offset, MIDIMSG_MESSAGE_ABORTED);
+    return 0;
+}
+
+/* Finds where a chunk can start from 'pos' on. 'p' has the state of the
+ * parser at 'from', where the previous chunk starts, and gets the state at
+ * the place found. Returns the length of the capture if there's none. */
+static ULONG resync(const UBYTE *data, ULONG length, ULONG from, ULONG pos,
+		    MIDICAP_PARSER *p)
+{
+    ULONG i, count = 0;
+    UBYTE byte, status = 0;
+    UBYTE running = p->parser.running;
+    int eox = 0;
+    long need;
+
+    /* The state only depends on the last status byte and on the number of
+     * data bytes since. An EOX after it ends a sysex, else it's an error
+     * which changes nothing. If there's none since 'from', a message starts
+     * there with the running status of 'p'. */
+    for (i = pos; i > from && !status; )
+    {
+	byte = data[--i];
+	if (byte < 0x80)
+	    count++;
+	else if (byte == 0xF7)
+	    eox = 1;
+	else if (byte < 0xF8)
+	    status = byte;
+    }
+    midicap_parser_init(p);
+    if (status == 0xF0 && !eox)
+    {
+	/* In a sysex: look for the next status byte, where the state doesn't
+	 * depend on what came before */
+	while (pos < length && (data[pos] < 0x80 || data[pos] == 0xF7 || data[pos] >= 0xF8))
+	    pos++;
+	return pos;
+    }
+    if (!status && running) /* Messages with running status since 'from' */
+    {
+	need = midiparse_data_length(running);
+	need = (need - count % need) % need;
+	p->parser.running = running;
+    }
+    else if (status && status < 0xF0) /* The status byte, then messages */
+    {
+	need = midiparse_data_length(status);
+	need = count ? (need - count % need) % need : need;
+	p->parser.running = status;
+    }
+    else if (status == 0xF1 || status == 0xF2 || status == 0xF3)
+	need = midiparse_data_length(status) - (long)count;
+    else /* Sysex ended, or no running status: data bytes are errors */
+	need = 0;
+
+    /* Skip the end of the message being received */
+    for (; need > 0 && pos < length; pos++)
+    {
+	byte = data[pos];
+	if (byte >= 0x80 && byte != 0xF7 && byte < 0xF8)
+	{
+	    midicap_parser_init(p);
+	    return pos;
+	}
+	if (byte < 0x80)
+	    need--;
+    }
+    return pos;
+}
+
+static void parse_chunk(CHUNK *chunk)
+{
+    chunk->result = midicap_parse(&chunk->parser, chunk->data, chunk->from,
+				  chunk->to, &chunk->list);
+    if (!chunk->result)
+	chunk->result = midicap_finish(&chunk->parser, chunk->to, chunk->more,
+				       &chunk->list);
+}
+
+static void copy_chunk(CHUNK *chunk)
+{
+    if (chunk->dest != NULL && chunk->list.count)
+	memcpy(chunk->dest, chunk->list.msgs, chunk->list.count * sizeof(MIDICAP_MSG));
+    midicap_list_free(&chunk->list);
+}
+
+#ifdef __TOS__
+
+static void run(CHUNK *chunks, short count, void (*function)(CHUNK *))
+{
+    short i;
+
+    for (i = 0; i < count; i++)
+	(*function)(&chunks[i]);
+}
+
+#else
+
+typedef struct {
+    CHUNK *chunk;
+    void (*function)(CHUNK *);
+} JOB;
+
+static void *chunk_thread(void *job)
+{
+    (*((JOB *)job)->function)(((JOB *)job)->chunk);
+    return NULL;
+}
+
+/* Calls 'function' for each chunk, each one in its own thread. The first
+ * chunk is done by this thread, and any chunk whose thread can't be
+ * started too. */
+static void run(CHUNK *chunks, short count, void (*function)(CHUNK *))
+{
+    pthread_t threads[MIDICAP_MAX_CHUNKS];
+    JOB jobs[MIDICAP_MAX_CHUNKS];
+    int started[MIDICAP_MAX_CHUNKS];
+    short i;
+
+    for (i = 1; i < count; i++)
+    {
+	jobs[i].chunk = &chunks[i];
+	jobs[i].function = function;
+	started[i] = !pthread_create(&threads[i], NULL, chunk_thread, &jobs[i]);
+    }
+    (*function)(&chunks[0]);
+    for (i = 1; i < count; i++)
+    {
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	else
+	    (*function)(&chunks[i]);
+    }
+}
+
+#endif
+
+
+/* Loading of captures */
+
+#ifdef __TOS__
+
+#include <tos.h>
+
+/* No virtual memory, the capture is read in one go */
+UBYTE *midicap_map(const char *filename, ULONG *length)
+{
+    UBYTE *data;
+    long handle;
+
+    handle = Fopen(filename, 0);
+    if (handle < 0)
+	return NULL;
+    *length = Fseek(0L, (short)handle, 2);
+    Fseek(0L, (short)handle, 0);
+    data = malloc(*length ? *length : 1);
+    if (data != NULL && Fread((short)handle, *length, data) != *length)
+    {
+	free(data);
+	data = NULL;
+    }
+    Fclose((short)handle);
+    return data;
+}
+
+void midicap_unmap(UBYTE *data, ULONG length)
+{
+    free(data);
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+UBYTE *midicap_map(const char *filename, ULONG *length)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &st) < 0)
+    {
+	close(fd);
+	return NULL;
+    }
+    *length = st.st_size;
+    /* mmap can't map an empty file */
+    data = mmap(NULL, *length ? *length : 1, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+	return NULL;
+    madvise(data, *length ? *length : 1, MADV_SEQUENTIAL);
+    return data;
+}
+
+void midicap_unmap(UBYTE *data, ULONG length)
+{
+    munmap(data, length ? length : 1);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MIDICAP_H
+#define MIDICAP_H
+
+/* Offline parsing of raw MIDI captures. See midicap.c. */
+
+#include "midimsg.h"
+#include "midiparse.h"
+
+/* Maximum number of chunks parsed at the same time */
+#define MIDICAP_MAX_CHUNKS 64
+
+/* A message found in the capture. Its timestamp is the position of its first
+ * byte. A status of 0 means an error (MIDIMSG_ error code in data1). */
+typedef struct {
+    ULONG offset;
+    ULONG end;		/* Sysex: position after its last byte */
+    UBYTE status;
+    UBYTE data1;
+    UBYTE data2;
+} MIDICAP_MSG;
+
+typedef struct {
+    MIDICAP_MSG *msgs;
+    ULONG count;
+    ULONG size;
+} MIDICAP_LIST;
+
+/* Parser context. Each chunk has its own. */
+typedef struct {
+    MIDIPARSE parser;
+    MIDICAP_MSG msg;	/* Message being received */
+} MIDICAP_PARSER;
+
+void midicap_list_init(MIDICAP_LIST *list);
+void midicap_list_free(MIDICAP_LIST *list);
+
+void midicap_parser_init(MIDICAP_PARSER *p);
+int midicap_parse(MIDICAP_PARSER *p, const UBYTE *data, ULONG from, ULONG to,
+		  MIDICAP_LIST *out);
+int midicap_finish(MIDICAP_PARSER *p, ULONG offset, int more, MIDICAP_LIST *out);
+
+short midicap_split(const UBYTE *data, ULONG length, short n, ULONG *starts,
+		    MIDICAP_PARSER *parsers);
+int midicap_parse_all(const UBYTE *data, ULONG length, short n, MIDICAP_LIST *out);
+
+UBYTE *midicap_map(const char *filename, ULONG *length);
+void midicap_unmap(UBYTE *data, ULONG length);
+
+#endif
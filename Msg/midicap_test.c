@@ -0,0 +1,324 @@
+/* Tests for midicap: makes a random capture with running status, sysex,
+ * realtime bytes in the middle of messages and cut messages, checks that it
+ * gives back the messages put in, and that any number of chunks gives
+ * exactly what a parse in one go gives, also when it's all running status.
+ * Then measures how fast a bigger capture is parsed. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "midicap.h"
+#include "miditest.h"
+
+#define CHECK_SIZE 2000000L	/* bytes */
+#define SPEED_SIZE 64000000L	/* bytes */
+#define CAPTURE_FILE "midicap.tmp"
+
+static UBYTE *capture;
+static ULONG length;
+
+/* What we put in */
+static MIDITEST_SUM expected;
+
+/* Message cut by the next status byte */
+static int cut_sysex, cut_message;
+static ULONG cut_start;
+
+/* Counts a message found */
+static void checksum(MIDITEST_SUM *s, MIDICAP_MSG *msg)
+{
+    miditest_sum(s, msg->status, msg->data1, msg->data2, msg->offset, msg->end);
+}
+
+static void expect(UBYTE status, UBYTE d1, UBYTE d2, ULONG offset, ULONG end)
+{
+    miditest_sum(&expected, status, d1, d2, offset, end);
+}
+
+/* Adds a byte to the capture, a realtime byte may arrive before it. Returns
+ * its position. */
+static ULONG add(UBYTE byte)
+{
+    UBYTE rt;
+
+    if (!miditest_rnd(30))
+    {
+	rt = 0xF8 + miditest_rnd(8);
+	expect(rt, 0, 0, length, length);
+	capture[length++] = rt;
+    }
+    capture[length] = byte;
+    return length++;
+}
+
+/* Adds a status byte, which cuts the message being sent if there's one */
+static ULONG add_status(UBYTE byte)
+{
+    ULONG pos = add(byte);
+
+    if (cut_sysex)
+	expect(0xF0, 0, 0, cut_start, pos);
+    if (cut_message)
+	expect(0, MIDIMSG_MESSAGE_ABORTED, 0, pos, pos);
+    cut_sysex = cut_message = 0;
+    return pos;
+}
+
+static short data_length(UBYTE status)
+{
+    return (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 1 : 2;
+}
+
+static void generate(ULONG size)
+{
+    static const UBYTE types[] = { 0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0 };
+    UBYTE running = 0;
+    UBYTE status, d1, d2;
+    ULONG start;
+    short j, n;
+    int cut;
+
+    length = 0;
+    expected.count = expected.sum = 0;
+    while (length < size - 1000)
+    {
+	cut = !miditest_rnd(40);
+	switch (miditest_rnd(20))
+	{
+	case 0: /* Sysex */
+	    start = add_status(0xF0);
+	    n = miditest_rnd(300);
+	    for (j = 0; j < n; j++)
+		add(miditest_rnd(128));
+	    if (cut)
+	    {
+		cut_sysex = 1;
+		cut_start = start;
+	    }
+	    else
+		expect(0xF0, 0, 0, start, add(0xF7) + 1);
+	    running = 0;
+	    break;
+	case 1: /* Song position */
+	    d1 = miditest_rnd(128);
+	    d2 = miditest_rnd(128);
+	    start = add_status(0xF2);
+	    add(d1);
+	    add(d2);
+	    expect(0xF2, d1, d2, start, start);
+	    running = 0;
+	    break;
+	case 2: /* Tune request */
+	    start = add_status(0xF6);
+	    expect(0xF6, 0, 0, start, start);
+	    running = 0;
+	    break;
+	case 3: /* Data without status */
+	    if (running || cut_message || cut_sysex)
+		break;
+	    start = add(miditest_rnd(128));
+	    expect(0, MIDIMSG_UNEXPECTED_DATA, 0, start, start);
+	    break;
+	default: /* Channel message, use running status when possible */
+	    status = types[miditest_rnd(sizeof(types))] | miditest_rnd(16);
+	    if (miditest_rnd(2) && running && !cut_message && !cut_sysex)
+		status = running;
+	    d1 = miditest_rnd(128);
+	    d2 = data_length(status) == 2 ? miditest_rnd(128) : 0;
+	    if (status != running || cut_message || cut_sysex)
+	    {
+		start = add_status(status);
+		add(d1);
+	    }
+	    else
+		start = add(d1);
+	    running = status;
+	    if (cut && data_length(status) == 2)
+	    {
+		/* Lost when the next status byte comes */
+		cut_message = 1;
+		running = 0;
+		break;
+	    }
+	    if (data_length(status) == 2)
+		add(d2);
+	    expect(status, d1, d2, start, start);
+	}
+    }
+    /* A message cut at the end of the capture isn't in the output */
+    add_status(0xF6);
+    expect(0xF6, 0, 0, length - 1, length - 1);
+}
+
+/* Notes on one channel, all with running status but the first one */
+static void generate_running(ULONG size)
+{
+    UBYTE d1, d2;
+    ULONG start;
+
+    length = 0;
+    expected.count = expected.sum = 0;
+    while (length < size - 1000)
+    {
+	d1 = miditest_rnd(128);
+	d2 = miditest_rnd(128);
+	start = length ? add(d1) : add_status(0x90);
+	if (start == 0)
+	    add(d1);
+	add(d2);
+	expect(0x90, d1, d2, start, start);
+    }
+}
+
+static int same(MIDICAP_LIST *a, MIDICAP_LIST *b)
+{
+    MIDICAP_MSG *x, *y;
+    ULONG i;
+
+    if (a->count != b->count)
+	return 0;
+    for (i = 0; i < a->count; i++)
+    {
+	x = &a->msgs[i];
+	y = &b->msgs[i];
+	if (x->offset != y->offset || x->end != y->end || x->status != y->status
+	    || x->data1 != y->data1 || x->data2 != y->data2)
+	    return 0;
+    }
+    return 1;
+}
+
+static double seconds(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Writes the capture to a file and maps it back */
+static UBYTE *save_and_map(ULONG *mapped_length)
+{
+    FILE *f = fopen(CAPTURE_FILE, "wb");
+
+    if (f == NULL || fwrite(capture, 1, length, f) != length)
+	return NULL;
+    fclose(f);
+    return midicap_map(CAPTURE_FILE, mapped_length);
+}
+
+int main(int argc, char *argv[])
+{
+    MIDICAP_PARSER parser;
+    MIDICAP_LIST whole, list;
+    MIDICAP_PARSER parsers[MIDICAP_MAX_CHUNKS];
+    ULONG starts[MIDICAP_MAX_CHUNKS];
+    UBYTE *data;
+    ULONG mapped_length, i;
+    MIDITEST_SUM sum;
+    double t, t1;
+    short n;
+    int ok = 1;
+
+    capture = malloc(SPEED_SIZE + 1000);
+    if (capture == NULL)
+	return 1;
+
+    /* Correctness */
+    generate(CHECK_SIZE);
+    data = save_and_map(&mapped_length);
+    if (data == NULL || mapped_length != length)
+    {
+	printf("Can't map the capture !\n");
+	return 1;
+    }
+
+    midicap_list_init(&whole);
+    midicap_parser_init(&parser);
+    midicap_parse(&parser, data, 0, length, &whole);
+    midicap_finish(&parser, length, 0, &whole);
+    sum.count = sum.sum = 0;
+    for (i = 0; i < whole.count; i++)
+	checksum(&sum, &whole.msgs[i]);
+    printf("Bytes             : %lu\n", length);
+    printf("Messages          : %lu put in, %lu parsed\n", expected.count, whole.count);
+    if (whole.count != expected.count || sum.sum != expected.sum)
+    {
+	printf("Wrong messages !\n");
+	ok = 0;
+    }
+
+    for (n = 1; n <= MIDICAP_MAX_CHUNKS; n++)
+    {
+	if (midicap_parse_all(data, length, n, &list) || !same(&whole, &list))
+	{
+	    printf("Different with %d chunks !\n", n);
+	    ok = 0;
+	}
+	midicap_list_free(&list);
+    }
+    /* Small pieces, so chunks are cut everywhere */
+    for (i = 1; i < 1000; i++)
+    {
+	midicap_list_free(&whole);
+	midicap_parser_init(&parser);
+	midicap_parse(&parser, data, 0, i, &whole);
+	midicap_finish(&parser, i, 0, &whole);
+	if (midicap_parse_all(data, i, MIDICAP_MAX_CHUNKS, &list) || !same(&whole, &list))
+	{
+	    printf("Different with %lu bytes !\n", i);
+	    ok = 0;
+	}
+	midicap_list_free(&list);
+    }
+    midicap_list_free(&whole);
+    midicap_unmap(data, mapped_length);
+
+    /* Running status all along, the chunks have to start in the middle */
+    generate_running(CHECK_SIZE);
+    if (midicap_split(capture, length, MIDICAP_MAX_CHUNKS, starts, parsers) != MIDICAP_MAX_CHUNKS)
+    {
+	printf("Running status isn't cut !\n");
+	ok = 0;
+    }
+    for (n = 1; n <= MIDICAP_MAX_CHUNKS; n++)
+    {
+	if (midicap_parse_all(capture, length, n, &list))
+	    ok = 0;
+	sum.count = sum.sum = 0;
+	for (i = 0; i < list.count; i++)
+	    checksum(&sum, &list.msgs[i]);
+	if (list.count != expected.count || sum.sum != expected.sum)
+	{
+	    printf("Running status wrong with %d chunks !\n", n);
+	    ok = 0;
+	}
+	midicap_list_free(&list);
+    }
+    printf("Running status    : %lu messages\n", expected.count);
+
+    /* Speed */
+    generate(SPEED_SIZE);
+    data = save_and_map(&mapped_length);
+    remove(CAPTURE_FILE);
+    if (data == NULL)
+	return 1;
+    t1 = 0;
+    for (n = 1; n <= 16; n *= 2)
+    {
+	t = seconds();
+	midicap_parse_all(data, length, n, &list);
+	t = seconds() - t;
+	if (n == 1)
+	    t1 = t;
+	printf("%2d chunks         : %7.1f MB/s, x%.2f\n", n, length / t / 1e6, t1 / t);
+	midicap_list_free(&list);
+    }
+    midicap_unmap(data, mapped_length);
+    free(capture);
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+/* This module merges several MIDI inputs into one output.
+ * This is nothing Atari specific.
+ *
+ * How to use: for each input, set a buffer and its size in a MIDIMRG_INPUT,
+ * then call midimrg_init. Call midimrg_process with each byte received,
+ * the input it comes from and its timestamp (see midits.h). Then call
+ * midimrg_run from time to time with the time up to which all inputs have
+ * been read: the messages received until then are sent to the output
+ * callback in the order of their timestamps. Messages that started later
+ * than a message still being received wait until it's complete.
+ *
+ * How it works: each input has its own parser (see midiparse.c), running
+ * status is expanded and complete messages are stored in the input's buffer,
+ * so we never split a message. Realtime bytes are sent to the output right
+ * away, like midimsg_process handles them first, even if a message is being
+ * received (they can't cancel running status so this doesn't disturb the
+ * output).
+ * Inputs having messages are kept in a heap by the timestamp of their oldest
+ * message, so picking the next message is O(log n) for n inputs.
+ * A message being received holds back the messages which started after it
+ * on the other inputs, so the output stays in order. A sysex can take
+ * seconds though, so it's ordered by the time it's complete instead and
+ * holds nothing back. Other messages hold back for MIDIMRG_HOLD at most, in
+ * case their end was lost; if they complete after that they go out late.
+ * Running status is then used again on the output, whatever input the
+ * messages come from.
+ * If there's a problem, the error callback is called with the input and one
+ * of the MIDIMRG_ error codes.
+ */
+
+#include "midimrg.h"
+
+static void empty_error(short input, short number) { }
+
+static void put(MIDIMRG *m, short i, UBYTE byte);
+static void begin(MIDIMRG *m, short i, TIMESTAMP ts);
+static void commit(MIDIMRG *m, short i);
+static void emit(MIDIMRG *m, short i);
+static void merge(MIDIMRG *m, TIMESTAMP now, int all);
+
+/* Heap management */
+static int earlier(MIDIMRG *m, short a, short b);
+static void heap_push(MIDIMRG *m, short i);
+static void heap_sift_down(MIDIMRG *m, short pos);
+
+#define OLDEST(in) ((in)->queue[(in)->first].timestamp)
+
+
+void midimrg_init(MIDIMRG *m, MIDIMRG_INPUT *inputs, short *heap, short n,
+		  void (*output)(UBYTE, TIMESTAMP))
+{
+    short i;
+
+    m->inputs = inputs;
+    m->n = n;
+    m->heap = heap;
+    m->heap_size = 0;
+    m->running = 0;
+    m->output = output;
+    m->error = empty_error;
+
+    for (i = 0; i < n; i++)
+    {
+	inputs[i].read = inputs[i].write = inputs[i].start = 0;
+	inputs[i].first = inputs[i].count = 0;
+	midiparse_init(&inputs[i].parser);
+	inputs[i].dropping = 0;
+    }
+}
+
+/* Receives a byte from an input */
+void midimrg_process(MIDIMRG *m, short i, UBYTE byte, TIMESTAMP ts)
+{
+    MIDIMRG_INPUT *in = &m->inputs[i];
+    short flags = midiparse_byte(&in->parser, byte);
+
+    if (flags & MIDIPARSE_REALTIME) /* Goes out right away */
+    {
+	(*m->output)(byte, ts);
+	return;
+    }
+    if (flags & MIDIPARSE_ERROR)
+    {
+	(*m->error)(i, MIDIMRG_UNEXPECTED_DATA);
+	return;
+    }
+
+    if (flags & MIDIPARSE_SYSEX_CUT) /* Terminated by this status byte */
+    {
+	in->timestamp = ts;
+	put(m, i, 0xF7);
+	commit(m, i);
+    }
+    else if (flags & MIDIPARSE_ABORTED)
+    {
+	in->write = in->start;
+	(*m->error)(i, MIDIMRG_MESSAGE_ABORTED);
+    }
+
+    if (flags & MIDIPARSE_BEGIN)
+    {
+	begin(m, i, ts);
+	if (byte < 0x80) /* Running status, expand it */
+	    put(m, i, in->parser.status);
+    }
+    if (flags & MIDIPARSE_STORE)
+    {
+	if (byte == 0xF7) /* A sysex is ordered by the time it's complete */
+	    in->timestamp = ts;
+	put(m, i, byte);
+    }
+    if (flags & MIDIPARSE_END)
+	commit(m, i);
+}
+
+/* Sends the messages received until now, in the order of their timestamps */
+void midimrg_run(MIDIMRG *m, TIMESTAMP now)
+{
+    merge(m, now, 0);
+}
+
+/* Sends all the messages received */
+void midimrg_flush(MIDIMRG *m)
+{
+    merge(m, 0, 1);
+}
+
+
+/* Stores a byte of the message being received */
+static void put(MIDIMRG *m, short i, UBYTE byte)
+{
+    MIDIMRG_INPUT *in = &m->inputs[i];
+    short next;
+
+    if (in->dropping)
+	return;
+
+    next = in->write + 1;
+    if (next == in->size)
+	next = 0;
+    if (next == in->read) /* Buffer full */
+    {
+	in->dropping = 1;
+	(*m->error)(i, MIDIMRG_OVERFLOW);
+	return;
+    }
+    in->buffer[in->write] = byte;
+    in->write = next;
+}
+
+/* A message starts, its bytes come next */
+static void begin(MIDIMRG *m, short i, TIMESTAMP ts)
+{
+    MIDIMRG_INPUT *in = &m->inputs[i];
+
+    in->write = in->start;
+    in->dropping = 0;
+    in->timestamp = ts;
+}
+
+/* The message being received is complete, queue it for merging */
+static void commit(MIDIMRG *m, short i)
+{
+    MIDIMRG_INPUT *in = &m->inputs[i];
+    MIDIMRG_MESSAGE *msg;
+
+    if (!in->dropping && in->count == MIDIMRG_QUEUE)
+    {
+	in->dropping = 1;
+	(*m->error)(i, MIDIMRG_OVERFLOW);
+    }
+    if (in->dropping)
+    {
+	in->write = in->start;
+	in->dropping = 0;
+	return;
+    }
+
+    msg = &in->queue[(in->first + in->count) % MIDIMRG_QUEUE];
+    msg->timestamp = in->timestamp;
+    msg->length = in->write - in->start;
+    if (msg->length < 0)
+	msg->length += in->size;
+    in->start = in->write;
+
+    if (++in->count == 1)
+	heap_push(m, i);
+}
+
+/* Sends the oldest message of an input to the output */
+static void emit(MIDIMRG *m, short i)
+{
+    MIDIMRG_INPUT *in = &m->inputs[i];
+    MIDIMRG_MESSAGE *msg = &in->queue[in->first];
+    UBYTE status = in->buffer[in->read];
+    short pos = in->read;
+    short n = msg->length;
+
+    if (status < 0xF0 && status == m->running)
+    {
+	/* Same status as the last one sent, skip it */
+	if (++pos == in->size)
+	    pos = 0;
+	n--;
+    }
+    else
+	m->running = status < 0xF0 ? status : 0;
+
+    while (n--)
+    {
+	(*m->output)(in->buffer[pos], msg->timestamp);
+	if (++pos == in->size)
+	    pos = 0;
+    }
+
+    in->read += msg->length;
+    if (in->read >= in->size)
+	in->read -= in->size;
+    if (++in->first == MIDIMRG_QUEUE)
+	in->first = 0;
+    in->count--;
+}
+
+static void merge(MIDIMRG *m, TIMESTAMP now, int all)
+{
+    short i;
+    int limited = 0;
+    TIMESTAMP limit;
+
+    /* A message being received started before the messages that come after
+     * it, but we only know it when it's complete, so they have to wait.
+     * Not for a sysex, nor for a message whose end seems lost. */
+    if (!all)
+    {
+	for (i = 0; i < m->n; i++)
+	{
+	    if (m->inputs[i].parser.expected > 0 &&
+		(long)(now - m->inputs[i].timestamp) <= MIDIMRG_HOLD &&
+		(!limited || (long)(m->inputs[i].timestamp - limit) < 0))
+	    {
+		limit = m->inputs[i].timestamp;
+		limited = 1;
+	    }
+	}
+    }
+
+    while (m->heap_size)
+    {
+	i = m->heap[0];
+	if (!all && ((long)(OLDEST(&m->inputs[i]) - now) > 0 ||
+		     (limited && (long)(OLDEST(&m->inputs[i]) - limit) >= 0)))
+	    break;
+
+	emit(m, i);
+
+	/* The input goes back into the heap with its next message, or leaves
+	 * it if it has no more */
+	if (!m->inputs[i].count)
+	    m->heap[0] = m->heap[--m->heap_size];
+	heap_sift_down(m, 0);
+    }
+}
+
+
+/* Compares the oldest messages of two inputs. Timestamps are compared as
+ * differences so they can wrap around. On a tie the first input goes first,
+ * so the output doesn't depend on the order the heap was built in. */
+static int earlier(MIDIMRG *m, short a, short b)
+{
+    long d = (long)(OLDEST(&m->inputs[a]) - OLDEST(&m->inputs[b]));
+
+    return d < 0 || (d == 0 && a < b);
+}
+
+static void heap_push(MIDIMRG *m, short i)
+{
+    short pos = m->heap_size++;
+    short parent;
+
+    while (pos > 0)
+    {
+	parent = (pos - 1) >> 1;
+	if (!earlier(m, i, m->heap[parent]))
+	    break;
+	m->heap[pos] = m->heap[parent];
+	pos = parent;
+    }
+    m->heap[pos] = i;
+}
+
+static void heap_sift_down(MIDIMRG *m, short pos)
+{
+    short i;
+    short child;
+
+    if (pos >= m->heap_size)
+	return;
+
+    i = m->heap[pos];
+    while ((child = (pos << 1) + 1) < m->heap_size)
+    {
+	if (child + 1 < m->heap_size && earlier(m, m->heap[child + 1], m->heap[child]))
+	    child++;
+	if (!earlier(m, m->heap[child], i))
+	    break;
+	m->heap[pos] = m->heap[child];
+	pos = child;
+    }
+    m->heap[pos] = i;
+}
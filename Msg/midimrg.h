@@ -0,0 +1,64 @@
+#ifndef MIDIMRG_H
+#define MIDIMRG_H
+
+/* Merges several MIDI inputs into one output. See midimrg.c. */
+
+#include "midimsg.h"
+#include "midiparse.h"
+
+/* Number of complete messages an input can hold until they're merged */
+#define MIDIMRG_QUEUE 32
+
+/* How long a channel or system common message being received may hold back
+ * the messages of the other inputs, in the unit of the timestamps (us with
+ * midits). A 3 byte message takes 960us at 31250 bauds, if it's not
+ * complete after this time its end was lost. */
+#define MIDIMRG_HOLD 10000
+
+/* Error codes */
+#define MIDIMRG_MESSAGE_ABORTED 1
+#define MIDIMRG_UNEXPECTED_DATA 2
+#define MIDIMRG_OVERFLOW 3
+
+typedef struct {
+    TIMESTAMP timestamp;
+    short length;
+} MIDIMRG_MESSAGE;
+
+typedef struct {
+    /* Bytes of the messages received, including their status byte */
+    UBYTE *buffer;
+    short size;
+    short read;		/* First byte of the oldest message */
+    short write;	/* Where the next byte of the message being received goes */
+    short start;	/* Where the message being received started */
+    /* Messages received, waiting to be merged */
+    MIDIMRG_MESSAGE queue[MIDIMRG_QUEUE];
+    short first;
+    short count;
+    /* Message being received */
+    MIDIPARSE parser;
+    TIMESTAMP timestamp;
+    short dropping;	/* Set if the message being received didn't fit */
+} MIDIMRG_INPUT;
+
+typedef struct {
+    MIDIMRG_INPUT *inputs;
+    short n;
+    /* Heap of the inputs having messages, by timestamp of their oldest */
+    short *heap;
+    short heap_size;
+    UBYTE running;	/* Running status of the output */
+    void (*output)(UBYTE byte, TIMESTAMP timestamp);
+    void (*error)(short input, short number);
+} MIDIMRG;
+
+/* The caller provides the inputs and a heap of n shorts, then sets the
+ * buffer and size of each input before calling midimrg_init. */
+void midimrg_init(MIDIMRG *m, MIDIMRG_INPUT *inputs, short *heap, short n,
+		  void (*output)(UBYTE, TIMESTAMP));
+void midimrg_process(MIDIMRG *m, short input, UBYTE byte, TIMESTAMP timestamp);
+void midimrg_run(MIDIMRG *m, TIMESTAMP now);
+void midimrg_flush(MIDIMRG *m);
+
+#endif
@@ -0,0 +1,360 @@
+/* Tests for midimrg: merges 16 random streams, then checks with midimsg that
+ * the output is valid, in order, and has all the messages of the inputs.
+ * Also checks that a long sysex or a message whose end was lost on an input
+ * doesn't hold back the others, and that running status is used on the
+ * output across inputs sharing a channel. */
+
+#include <stdio.h>
+
+#include "midimrg.h"
+#include "midits.h"
+#include "miditest.h"
+
+#define N_INPUTS 16
+#define N_MESSAGES 2000 /* per input */
+#define MAX_BYTES 40000 /* per input */
+#define LATENCY 5000 /* how late midimrg_run is called, in us */
+
+/* A byte as it arrives from an input */
+typedef struct {
+    UBYTE byte;
+    TIMESTAMP timestamp;
+} BYTE_IN;
+
+static BYTE_IN streams[N_INPUTS][MAX_BYTES];
+static long stream_length[N_INPUTS];
+
+static MIDIMRG merger;
+static MIDIMRG_INPUT inputs[N_INPUTS];
+static UBYTE buffers[N_INPUTS][512];
+static short heap[N_INPUTS];
+
+/* What we sent and what we got back */
+static MIDITEST_SUM expected, received;
+static unsigned long expected_clocks, received_clocks;
+static unsigned long expanded_bytes, output_bytes;
+static unsigned long shared_running;	/* Status bytes saved across inputs */
+static MIDIPARSE output_parser;
+static short last_input;
+static TIMESTAMP last_timestamp;
+static int errors, out_of_order;
+static int merge_errors[4];
+static unsigned long received_sysex;
+
+static void expect(UBYTE status, UBYTE d1, UBYTE d2, TIMESTAMP ts)
+{
+    miditest_sum(&expected, status, d1, d2, ts, 0);
+}
+
+static void receive(UBYTE status, UBYTE d1, UBYTE d2, TIMESTAMP ts)
+{
+    miditest_sum(&received, status, d1, d2, ts, 0);
+    if ((long)(ts - last_timestamp) < 0)
+	out_of_order++;
+    last_timestamp = ts;
+}
+
+/* Adds a byte to a stream, a clock may arrive before it. Returns the
+ * timestamp of the byte. */
+static TIMESTAMP add(short input, UBYTE byte, TIMESTAMP *ts)
+{
+    BYTE_IN *b;
+
+    if (!miditest_rnd(50))
+    {
+	b = &streams[input][stream_length[input]++];
+	b->byte = 0xF8;
+	b->timestamp = *ts;
+	*ts += MIDITS_BYTE_TIME;
+	expected_clocks++;
+    }
+    b = &streams[input][stream_length[input]++];
+    b->byte = byte;
+    b->timestamp = *ts;
+    *ts += MIDITS_BYTE_TIME;
+    expanded_bytes++;
+    return b->timestamp;
+}
+
+static void generate(short input)
+{
+    static const UBYTE types[] = { 0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0 };
+    TIMESTAMP ts = miditest_rnd(1000);
+    TIMESTAMP start;
+    UBYTE running = 0;
+    UBYTE status, d1, d2;
+    /* The second half of the inputs share the channels of the first two,
+     * so messages from different inputs can share running status */
+    UBYTE channel = input < N_INPUTS / 2 ? input : input & 1;
+    short i, j, length, sum;
+
+    for (i = 0; i < N_MESSAGES; i++)
+    {
+	ts += miditest_rnd(3000);
+	switch (miditest_rnd(20))
+	{
+	case 0: /* Sysex */
+	    length = 1 + miditest_rnd(20);
+	    add(input, 0xF0, &ts);
+	    sum = 0;
+	    for (j = 0; j < length; j++)
+	    {
+		d1 = miditest_rnd(128);
+		sum += d1;
+		add(input, d1, &ts);
+	    }
+	    /* A sysex is merged by the time it's complete */
+	    expect(0xF0, length, sum & 0xff, add(input, 0xF7, &ts));
+	    running = 0;
+	    break;
+	case 1: /* Song position */
+	    d1 = miditest_rnd(128);
+	    d2 = miditest_rnd(128);
+	    start = add(input, 0xF2, &ts);
+	    add(input, d1, &ts);
+	    add(input, d2, &ts);
+	    expect(0xF2, d1, d2, start);
+	    running = 0;
+	    break;
+	default: /* Channel message, use running status when possible */
+	    status = types[miditest_rnd(sizeof(types))] | channel;
+	    if (miditest_rnd(2) && running)
+		status = running;
+	    d1 = miditest_rnd(128);
+	    d2 = miditest_rnd(128);
+	    if (status != running)
+	    {
+		start = add(input, status, &ts);
+		add(input, d1, &ts);
+	    }
+	    else
+	    {
+		expanded_bytes++;
+		start = add(input, d1, &ts);
+	    }
+	    if ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0)
+		d2 = 0;
+	    else
+		add(input, d2, &ts);
+	    expect(status, d1, d2, start);
+	    running = status;
+	}
+    }
+}
+
+
+/* midimsg callbacks to check the output */
+static void midi_error(short code) {
+    printf("Error %d in output !\n", code);
+    errors++;
+}
+
+static void note_off(MIDIMSG_NOTE_OFF *msg) {
+    receive(0x80 | msg->channel, msg->note, msg->velocity, msg->timestamp);
+}
+
+static void note_on(MIDIMSG_NOTE_ON *msg) {
+    receive(0x90 | msg->channel, msg->note, msg->velocity, msg->timestamp);
+}
+
+static void polyp(MIDIMSG_POLY_PRESSURE *msg) {
+    receive(0xA0 | msg->channel, msg->note, msg->value, msg->timestamp);
+}
+
+static void controlc(MIDIMSG_CONTROL_CHANGE *msg) {
+    receive(0xB0 | msg->channel, msg->control, msg->value, msg->timestamp);
+}
+
+static void programc(MIDIMSG_PROGRAM_CHANGE *msg) {
+    receive(0xC0 | msg->channel, msg->program, 0, msg->timestamp);
+}
+
+static void aftertouch(MIDIMSG_CHANNEL_PRESSURE *msg) {
+    receive(0xD0 | msg->channel, msg->value, 0, msg->timestamp);
+}
+
+static void pitchbend(MIDIMSG_PITCH_BEND *msg) {
+    receive(0xE0 | msg->channel, msg->value & 0x7f, msg->value >> 7, msg->timestamp);
+}
+
+static void clock(TIMESTAMP ts) {
+    received_clocks++;
+}
+
+static void system_exclusive(MIDIMSG_SYSEX *sysex) {
+    short i, sum = 0;
+
+    /* Without F0 and F7 */
+    for (i = 1; i < sysex->length - 1; i++)
+	sum += sysex->data[i];
+    receive(0xF0, sysex->length - 2, sum & 0xff, sysex->timestamp);
+    received_sysex++;
+}
+
+static void song_position(MIDIMSG_SONG_POSITION *pos)
+{
+    receive(0xF2, pos->position & 0x7f, pos->position >> 7, pos->timestamp);
+}
+
+/* midimrg output, goes straight to midimsg. midimsg sets the channel of the
+ * messages to their status byte. While a message goes out, the input it
+ * comes from is at the top of the merger's heap: a message using the
+ * running status of a message from another input saved a status byte. */
+static void output(UBYTE byte, TIMESTAMP ts)
+{
+    short flags = midiparse_byte(&output_parser, byte);
+
+    if (flags & MIDIPARSE_BEGIN)
+    {
+	if (byte < 0x80 && merger.heap[0] != last_input)
+	    shared_running++;
+	last_input = merger.heap[0];
+    }
+    output_bytes++;
+    midimsg_process(byte, ts);
+}
+
+static void merge_error(short input, short code)
+{
+    merge_errors[code]++;
+}
+
+
+/* Input 0 sends a sysex byte every 2ms while input 1 plays notes, which
+ * must go out as they come. Then input 0 sends a status byte and nothing
+ * else: the notes wait MIDIMRG_HOLD for its end, then go out anyway. */
+static int hold_test(void)
+{
+    TIMESTAMP ts = 0;
+    unsigned long before;
+    short i, held;
+    int sysex_ok, lost_ok;
+
+    midimrg_init(&merger, inputs, heap, 2, output);
+    merger.error = merge_error;
+
+    before = received.count;
+    midimrg_process(&merger, 0, 0xF0, ts);
+    for (i = 0; i < 40; i++)
+    {
+	ts += 1000;
+	if (i & 1)
+	    midimrg_process(&merger, 0, i, ts);
+	midimrg_process(&merger, 1, 0x90, ts);
+	midimrg_process(&merger, 1, 60, ts + 320);
+	midimrg_process(&merger, 1, 100, ts + 640);
+	midimrg_run(&merger, ts + 640);
+    }
+    sysex_ok = received.count - before == 40 && !received_sysex;
+    midimrg_process(&merger, 0, 0xF7, ts + 1000);
+    midimrg_run(&merger, ts + 1000);
+    sysex_ok &= received_sysex == 1 && !merge_errors[MIDIMRG_OVERFLOW];
+
+    before = received.count;
+    held = 0;
+    ts += 2000;
+    midimrg_process(&merger, 0, 0x90, ts);
+    for (i = 0; i < 40; i++)
+    {
+	ts += 1000;
+	midimrg_process(&merger, 1, 0x90, ts);
+	midimrg_process(&merger, 1, 60, ts + 320);
+	midimrg_process(&merger, 1, 100, ts + 640);
+	midimrg_run(&merger, ts + 640);
+	if (received.count - before < i + 1)
+	    held++;
+    }
+    lost_ok = received.count - before == 40 && held <= MIDIMRG_HOLD / 1000
+	&& !merge_errors[MIDIMRG_OVERFLOW];
+    midimrg_process(&merger, 0, 0x80, ts + 1000); /* Aborts the lost one */
+    lost_ok &= merge_errors[MIDIMRG_MESSAGE_ABORTED] == 1;
+    midimrg_flush(&merger);
+
+    printf("Sysex in progress : %s\n", sysex_ok ? "doesn't hold back" : "holds back, FAILED");
+    printf("Lost message end  : %d notes held, %s\n", held, lost_ok ? "OK" : "FAILED");
+    return sysex_ok && lost_ok;
+}
+
+
+int main(int argc, char *argv[]) {
+    UBYTE sysex_buffer[32];
+    long position[N_INPUTS];
+    TIMESTAMP now;
+    short i, next;
+    int ok, hold_ok;
+
+    midimsg_init(sysex_buffer, sizeof(sysex_buffer)/sizeof(UBYTE));
+    midimsg_callbacks.error = midi_error;
+    midimsg_callbacks.note_off = note_off;
+    midimsg_callbacks.note_on = note_on;
+    midimsg_callbacks.poly_pressure = polyp;
+    midimsg_callbacks.control_change = controlc;
+    midimsg_callbacks.program_change = programc;
+    midimsg_callbacks.channel_pressure = aftertouch;
+    midimsg_callbacks.pitch_bend = pitchbend;
+    midimsg_callbacks.clock = clock;
+    midimsg_callbacks.system_exclusive = system_exclusive;
+    midimsg_callbacks.song_position = song_position;
+
+    for (i = 0; i < N_INPUTS; i++)
+    {
+	inputs[i].buffer = buffers[i];
+	inputs[i].size = sizeof(buffers[i]);
+    }
+    hold_ok = hold_test();
+    output_bytes = 0;
+    received.count = 0;
+    received.sum = 0;
+    received_sysex = 0;
+    last_timestamp = 0;
+
+    for (i = 0; i < N_INPUTS; i++)
+    {
+	generate(i);
+	inputs[i].buffer = buffers[i];
+	inputs[i].size = sizeof(buffers[i]);
+	position[i] = 0;
+    }
+    midimrg_init(&merger, inputs, heap, N_INPUTS, output);
+    midiparse_init(&output_parser);
+    last_input = -1;
+
+    /* Feed the bytes in the order they arrive and run the merger as we go,
+     * a bit late like a program polling its inputs. */
+    for (;;)
+    {
+	next = -1;
+	for (i = 0; i < N_INPUTS; i++)
+	    if (position[i] < stream_length[i] &&
+		(next < 0 || streams[i][position[i]].timestamp < streams[next][position[next]].timestamp))
+		next = i;
+	if (next < 0)
+	    break;
+
+	now = streams[next][position[next]].timestamp;
+	midimrg_process(&merger, next, streams[next][position[next]].byte, now);
+	position[next]++;
+	if (!miditest_rnd(10))
+	    midimrg_run(&merger, now - LATENCY);
+    }
+    midimrg_flush(&merger);
+    midimsg_exit();
+
+    /* Realtime bytes go out before the messages queued, so messages are
+     * checked in order but not against clocks */
+    ok = hold_ok && !errors && !out_of_order
+	&& received.count == expected.count && received.sum == expected.sum
+	&& received_clocks == expected_clocks
+	&& output_bytes < expanded_bytes + expected_clocks && shared_running > 0;
+
+    printf("Inputs            : %d\n", N_INPUTS);
+    printf("Messages          : %lu sent, %lu received\n", expected.count, received.count);
+    printf("Clocks            : %lu sent, %lu received\n", expected_clocks, received_clocks);
+    printf("Out of order      : %d\n", out_of_order);
+    printf("Bytes w/o running : %lu\n", expanded_bytes + expected_clocks);
+    printf("Bytes sent        : %lu\n", output_bytes);
+    printf("Shared running    : %lu status bytes saved across inputs\n", shared_running);
+    printf("%s\n", ok ? "OK" : "FAILED");
+
+    return ok ? 0 : 1;
+}
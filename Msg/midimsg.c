@@ -18,7 +18,14 @@ static int sysex_max_size;
 static MIDIMSG_SYSEX system_exclusive;
 static int sysex_errored;
 static MIDIMSG_MTC_QUARTER_FRAME mtc_quarter_frame;
-static UWORD song_position;
+static MIDIMSG_SONG_POSITION song_position;
+static MIDIMSG_SONG_SELECT song_select;
+
+/* Timestamp of the message being received, and flag telling that the next
+ * data byte starts a new message using running status, so it must set the
+ * timestamp (like capturets in midimsg.s). */
+static TIMESTAMP timestamp;
+static int capture_ts;
 
 MIDIMSG_CALLBACKS midimsg_callbacks;
 
@@ -44,12 +51,12 @@ static void pitchb_lsb(UBYTE);
 static void pitchb_msb(UBYTE);
 
 /* System real time message storage functions */
-static void clock(void);
-static void song_start(void);
-static void song_continue(void);
-static void song_stop(void);
-static void active_sensing(void);
-static void reset(void);
+static void clock(TIMESTAMP);
+static void song_start(TIMESTAMP);
+static void song_continue(TIMESTAMP);
+static void song_stop(TIMESTAMP);
+static void active_sensing(TIMESTAMP);
+static void reset(TIMESTAMP);
 
 /* System common storage functions */
 static void sysex(UBYTE);
@@ -69,6 +76,7 @@ static void err_message_unexpected_data(UBYTE);
 static void reset_callbacks(void);
 static void empty_void(void) { }
 static void empty_byte(UBYTE whatever) { }
+static void empty_timestamp(TIMESTAMP whatever) { }
 
 static void (*store_next)(UBYTE) = err_message_aborted;
 static void (*channel_msg_store[])(UBYTE) =
@@ -81,14 +89,14 @@ static void (*channel_msg_store[])(UBYTE) =
     channelp_channel,
     pitchb_channel
 };
-static void (*realtime_msg_store[])(void) =
+static void (*realtime_msg_store[])(TIMESTAMP) =
 {
     clock,
-    empty_void,
+    empty_timestamp,
     song_start,
     song_continue,
     song_stop,
-    empty_void,
+    empty_timestamp,
     active_sensing,
     reset
 };
@@ -114,25 +122,27 @@ static void reset_callbacks(void)
     midimsg_callbacks.channel_pressure = (void(*)(MIDIMSG_CHANNEL_PRESSURE*))empty_void;
     midimsg_callbacks.pitch_bend = (void(*)(MIDIMSG_PITCH_BEND*))empty_void;
 
-    midimsg_callbacks.clock = empty_void;
-    midimsg_callbacks.song_start = empty_void;
-    midimsg_callbacks.song_continue = empty_void;
-    midimsg_callbacks.song_stop = empty_void;
-    midimsg_callbacks.active_sensing = empty_void;
-    midimsg_callbacks.reset = empty_void;
+    midimsg_callbacks.clock = empty_timestamp;
+    midimsg_callbacks.song_start = empty_timestamp;
+    midimsg_callbacks.song_continue = empty_timestamp;
+    midimsg_callbacks.song_stop = empty_timestamp;
+    midimsg_callbacks.active_sensing = empty_timestamp;
+    midimsg_callbacks.reset = empty_timestamp;
 
     midimsg_callbacks.system_exclusive = (void(*)(MIDIMSG_SYSEX*))empty_void;
     midimsg_callbacks.mtc_quarter_frame = (void(*)(MIDIMSG_MTC_QUARTER_FRAME*))empty_void;
-    midimsg_callbacks.song_position = (void(*)(UWORD))empty_void;
-    midimsg_callbacks.song_select = (void(*)(UBYTE))empty_void;
+    midimsg_callbacks.song_position = (void(*)(MIDIMSG_SONG_POSITION*))empty_void;
+    midimsg_callbacks.song_select = (void(*)(MIDIMSG_SONG_SELECT*))empty_void;
+    midimsg_callbacks.tune_request = empty_timestamp;
 }
 
-void midimsg_init(UBYTE *sysex_buffer, int sysex_buffer_size)
+void midimsg_init(UBYTE *sysex_buffer, short sysex_buffer_size)
 {
     sysex_max_size = sysex_buffer_size;
     sysex_errored = 0;
     system_exclusive.length = 0;
     system_exclusive.data = sysex_buffer;
+    capture_ts = 0;
 
     reset_callbacks();
 }
@@ -143,16 +153,29 @@ void midimsg_exit(void)
 
 
 /* This is the one method to be used by users of this module. */
-void midimsg_process(UBYTE byte)
+void midimsg_process(UBYTE byte, TIMESTAMP ts)
 {
-  if (byte >= 0xF8) /* Realtime message */
-      (*realtime_msg_store[byte - 0xF8])();
+  if (byte >= 0xF8) /* Realtime message, doesn't touch the current timestamp */
+      (*realtime_msg_store[byte - 0xF8])(ts);
   else if (byte >=0xF0) /* System common message */
+  {
+      timestamp = ts;
+      capture_ts = 0;
       (*common_msg_store[byte - 0xF0])(byte);
+  }
   else if (byte >= 0x80) /* Channel message */
+  {
+      timestamp = ts;
+      capture_ts = 0;
       (*channel_msg_store[(byte - 0x80) >> 4])(byte);
+  }
   else
   {
+      if (capture_ts) /* First byte of a message using running status */
+      {
+	  timestamp = ts;
+	  capture_ts = 0;
+      }
       if (store_next)
 	  (*store_next)(byte);
       else
@@ -188,6 +211,8 @@ static void noteoff_velocity(UBYTE velocity)
 {
     note_off.velocity = velocity;
     store_next = noteoff_note;
+    note_off.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.note_off)(&note_off);
 }
 
@@ -207,6 +232,8 @@ static void noteon_velocity(UBYTE velocity)
 {
     note_on.velocity = velocity;
     store_next = noteon_note;
+    note_on.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.note_on)(&note_on);
 }
 
@@ -226,6 +253,8 @@ static void polyp_value(UBYTE value)
 {
     poly_pressure.value = value;
     store_next = polyp_note;
+    poly_pressure.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.poly_pressure)(&poly_pressure);    
 }
 
@@ -245,6 +274,8 @@ static void controlc_value(UBYTE value)
 {
     control_change.value = value;
     store_next = controlc_control;
+    control_change.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.control_change)(&control_change);    
 }
 
@@ -258,6 +289,8 @@ static void programc_program(UBYTE program)
 {
     program_change.program = program;
     store_next = programc_program;
+    program_change.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.program_change)(&program_change);
 }
 
@@ -270,7 +303,9 @@ static void channelp_channel(UBYTE channel)
 static void channelp_value(UBYTE value)
 {
     channel_pressure.value = value;
-    store_next = channelp_channel;
+    store_next = channelp_value;
+    channel_pressure.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.channel_pressure)(&channel_pressure);
 }
 
@@ -290,38 +325,40 @@ static void pitchb_msb(UBYTE msb)
 {
     pitch_bend.value |= (msb << 7);
     store_next = pitchb_lsb;
+    pitch_bend.timestamp = timestamp;
+    capture_ts = 1;
     (*midimsg_callbacks.pitch_bend)(&pitch_bend);
 }
 
 /* System real-time messages */
-static void clock(void)
+static void clock(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.clock)();
+    (*midimsg_callbacks.clock)(ts);
 }
 
-static void song_start(void)
+static void song_start(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.song_start)();
+    (*midimsg_callbacks.song_start)(ts);
 }
 
-static void song_continue(void)
+static void song_continue(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.song_continue)();
+    (*midimsg_callbacks.song_continue)(ts);
 }
 
-static void song_stop(void)
+static void song_stop(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.song_stop)();
+    (*midimsg_callbacks.song_stop)(ts);
 }
 
-static void active_sensing(void)
+static void active_sensing(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.active_sensing)();
+    (*midimsg_callbacks.active_sensing)(ts);
 }
 
-static void reset(void)
+static void reset(TIMESTAMP ts)
 {
-    (*midimsg_callbacks.reset)();
+    (*midimsg_callbacks.reset)(ts);
 }
 
 /* System common messages */
@@ -335,6 +372,7 @@ static void sysex(UBYTE byte)
 
 	sysex_errored = 0;
 	system_exclusive.length = 0;
+	system_exclusive.timestamp = timestamp;
 	store_next = sysex;
     }
 
@@ -365,8 +403,9 @@ static void mtc_quarter_frame_status(UBYTE msg)
 
 static void mtc_quarter_frame_data(UBYTE data)
 {
+    mtc_quarter_frame.timestamp = timestamp;
     mtc_quarter_frame.value = data & 0x0f;
-    mtc_quarter_frame.type = data & 0x70;
+    mtc_quarter_frame.type = (data >> 4) & 0x07;
     (*midimsg_callbacks.mtc_quarter_frame)(&mtc_quarter_frame);
     store_next = err_message_unexpected_data;
 }
@@ -378,15 +417,16 @@ static void song_position_status(UBYTE spos)
 
 static void song_position_lsb(UBYTE lsb)
 {
-    song_position = lsb;
+    song_position.position = lsb;
     store_next = song_position_msb;
 }
 
 static void song_position_msb(UBYTE msb)
 {
-    song_position |= (msb << 7);
+    song_position.position |= (msb << 7);
+    song_position.timestamp = timestamp;
     store_next = err_message_unexpected_data;
-    (*midimsg_callbacks.song_position)(song_position);
+    (*midimsg_callbacks.song_position)(&song_position);
 }
 
 static void song_select_status(UBYTE msg)
@@ -396,11 +436,14 @@ static void song_select_status(UBYTE msg)
 
 static void song_select_number(UBYTE song)
 {
-    (*midimsg_callbacks.song_select)(song);
+    song_select.song = song;
+    song_select.timestamp = timestamp;
+    store_next = err_message_unexpected_data;
+    (*midimsg_callbacks.song_select)(&song_select);
 }
 
 static void tune_request(UBYTE whatever)
 {
-    (*midimsg_callbacks.tune_request)();
+    (*midimsg_callbacks.tune_request)(timestamp);
 }
 
@@ -29,6 +29,9 @@
 ;
 ; Timestamping of messages is optional because it adds a bit of extra code
 ; (not much but if we're after performance, we want this to be optional).
+; A message gets the timestamp of its first byte: the status byte, or the
+; first data byte when running status is used. Realtime bytes received in
+; the middle of a message don't change the timestamp of that message.
 ;
 ; This code is written for Brainstorm Assemble, which is so much better than
 ; PASM (the Pure C's assembler). PASM has problems with the macro.
@@ -369,6 +372,7 @@ midimsg_process:
 	tst.b	capturets
 	beq.s	.notrs
 	move.l	d1,timestamp
+	clr.b	capturets ;only the first byte of the message sets the timestamp
 	ENDIF
 .notrs	movea.l	store_next,a1
 	cmpa.w	#0,a1
@@ -4,7 +4,7 @@
 
 #include "midimsg.h"
 
-static void midi_error(int code) {
+static void midi_error(short code) {
     switch (code) {
     case MIDIMSG_MESSAGE_ABORTED:
 	printf("Message aborted !\n");
@@ -22,84 +22,84 @@ static void midi_error(int code) {
 
 /* Channel messages */
 static void note_off(MIDIMSG_NOTE_OFF *msg) {
-    printf("Note Off     : %2x %2x %2x\n", msg->channel, msg->note, msg->velocity);
+    printf("%04lu Note Off     : %2x %2x %2x\n", msg->timestamp, msg->channel, msg->note, msg->velocity);
 }
 
 static void note_on(MIDIMSG_NOTE_ON *msg) {
-    printf("Note On      : %2x %2x %2x\n", msg->channel, msg->note, msg->velocity);
+    printf("%04lu Note On      : %2x %2x %2x\n", msg->timestamp, msg->channel, msg->note, msg->velocity);
 }
 
 static void polyp(MIDIMSG_POLY_PRESSURE *msg) {
-    printf("Poly pressure: %2x %2x %2x\n", msg->channel, msg->note, msg->value);
+    printf("%04lu Poly pressure: %2x %2x %2x\n", msg->timestamp, msg->channel, msg->note, msg->value);
 }
 
 static void controlc(MIDIMSG_CONTROL_CHANGE *msg) {
-    printf("Ctrl change  : %2x %2x %2x\n", msg->channel, msg->control, msg->value);
+    printf("%04lu Ctrl change  : %2x %2x %2x\n", msg->timestamp, msg->channel, msg->control, msg->value);
 }
 
 static void programc(MIDIMSG_PROGRAM_CHANGE *msg) {
-    printf("Prgrm change : %2x %2x\n", msg->channel, msg->program);
+    printf("%04lu Prgrm change : %2x %2x\n", msg->timestamp, msg->channel, msg->program);
 }
 
 static void aftertouch(MIDIMSG_CHANNEL_PRESSURE *msg) {
-    printf("Aftertouch   : %2x %2x\n", msg->channel, msg->value);
+    printf("%04lu Aftertouch   : %2x %2x\n", msg->timestamp, msg->channel, msg->value);
 }
 
 static void pitchbend(MIDIMSG_PITCH_BEND *msg) {
-    printf("Pitch bend   : %2x %5d\n", msg->channel, msg->value);
+    printf("%04lu Pitch bend   : %2x %5d\n", msg->timestamp, msg->channel, msg->value);
 }
 
 /* System realtime message */
-static void clock(void) {
-    printf("Clock\n");
+static void clock(TIMESTAMP ts) {
+    printf("%04lu Clock\n", ts);
 }
 
-static void song_start(void) {
-    printf("Song start\n");
+static void song_start(TIMESTAMP ts) {
+    printf("%04lu Song start\n", ts);
 }
 
-static void song_continue(void) {
-    printf("Song continue\n");
+static void song_continue(TIMESTAMP ts) {
+    printf("%04lu Song continue\n", ts);
 }
 
-static void song_stop(void) {
-    printf("Song stop\n");
+static void song_stop(TIMESTAMP ts) {
+    printf("%04lu Song stop\n", ts);
 }
 
-static void active_sensing(void) {
-    printf("Active sensing\n");
+static void active_sensing(TIMESTAMP ts) {
+    printf("%04lu Active sensing\n", ts);
 }
 
-static void reset(void) {
-    printf("Reset\n");
+static void reset(TIMESTAMP ts) {
+    printf("%04lu Reset\n", ts);
 }
 
 /* System common messages */
 static void system_exclusive(MIDIMSG_SYSEX *sysex) {
-    printf("Sysex        : ");
-    for (int i; i<sysex->length; i++)
+    printf("%04lu Sysex        : ", sysex->timestamp);
+    for (int i=0; i<sysex->length; i++)
 	printf("%2x ", sysex->data[i]);
     printf("\n");
 }
 
 static void mtc_quarter_frame(MIDIMSG_MTC_QUARTER_FRAME *mtc)
 {
-    printf("MTC 1/4 frame: %2x %2x\n", mtc->type, mtc->value);
+    printf("%04lu MTC 1/4 frame: %2x %2x\n", mtc->timestamp, mtc->type, mtc->value);
 }
 
-static void song_position(UWORD position)
+static void song_position(MIDIMSG_SONG_POSITION *pos)
 {
-    printf("Song position: %4x\n", position);
+    printf("%04lu Song position: %4x\n", pos->timestamp, pos->position);
 }
 
-static void song_select(UBYTE song)
+static void song_select(MIDIMSG_SONG_SELECT *song)
 {
-    printf("Song selection: %d\n", song);
+    printf("%04lu Song selection: %d\n", song->timestamp, song->song);
 }
 
-static void tune_request()
+static void tune_request(TIMESTAMP ts)
 {
-    printf("Tune request\n");
+    printf("%04lu Tune request\n", ts);
 }
 
 
@@ -161,10 +161,12 @@ int main(int argc, char *argv[]) {
     midimsg_callbacks.song_select = song_select;
     midimsg_callbacks.tune_request = tune_request;
     
-    /* Send the bytes to midimsg_process and let it fire callbacks */
+    /* Send the bytes to midimsg_process and let it fire callbacks. The
+     * timestamp is the position of the byte, so each message must show the
+     * position of its first byte (e.g. 1 for the note on containing a clock). */
     for (int i=0; i<sizeof(data)/sizeof(UBYTE); i++)
     {
-	midimsg_process(data[i]);
+	midimsg_process(data[i], i+1);
     }
 
     midimsg_exit();
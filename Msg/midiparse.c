@@ -0,0 +1,101 @@
+/* This module cuts a MIDI byte stream into messages, for the modules which
+ * need to know where messages start and end but do something else than
+ * midimsg with them (midimrg, midicap). This is nothing Atari specific.
+ *
+ * How to use: one MIDIPARSE per stream, set up by midiparse_init. Pass each
+ * byte to midiparse_byte, which tells what it does with MIDIPARSE_ flags,
+ * to handle in this order: what happens to the message being received
+ * (SYSEX_CUT or ABORTED), then the new message (BEGIN, STORE, END).
+ *
+ * It follows the MIDI specification: realtime bytes may come anywhere and
+ * change nothing, any status byte other than EOX ends the message being
+ * received (a sysex is terminated, other messages are lost) and system
+ * common messages cancel running status. So right after a status byte the
+ * state doesn't depend on what came before.
+ */
+
+#include "midiparse.h"
+
+void midiparse_init(MIDIPARSE *p)
+{
+    p->status = 0;
+    p->running = 0;
+    p->expected = 0;
+}
+
+short midiparse_byte(MIDIPARSE *p, UBYTE byte)
+{
+    short flags;
+
+    if (byte >= 0xF8)
+	return MIDIPARSE_REALTIME;
+
+    if (byte == 0xF7) /* End of sysex */
+    {
+	if (p->expected != -1)
+	    return MIDIPARSE_ERROR;
+	p->expected = 0;
+	return MIDIPARSE_STORE | MIDIPARSE_END;
+    }
+
+    if (byte >= 0x80) /* New message */
+    {
+	flags = midiparse_cut(p);
+	if (byte >= 0xF0) /* System common message, cancels running status */
+	{
+	    p->running = 0;
+	    if (byte == 0xF4 || byte == 0xF5) /* Undefined */
+		return flags;
+	    p->expected = byte == 0xF0 ? -1 : midiparse_data_length(byte);
+	}
+	else
+	{
+	    p->running = byte;
+	    p->expected = midiparse_data_length(byte);
+	}
+	p->status = byte;
+	flags |= MIDIPARSE_BEGIN | MIDIPARSE_STORE;
+	if (!p->expected) /* Tune request */
+	    flags |= MIDIPARSE_END;
+	return flags;
+    }
+
+    /* Data byte */
+    if (p->expected == -1)
+	return MIDIPARSE_STORE;
+    flags = MIDIPARSE_STORE;
+    if (!p->expected)
+    {
+	if (!p->running)
+	    return MIDIPARSE_ERROR;
+	/* Running status: the message starts with this byte */
+	p->status = p->running;
+	p->expected = midiparse_data_length(p->running);
+	flags |= MIDIPARSE_BEGIN;
+    }
+    if (--p->expected == 0)
+	flags |= MIDIPARSE_END;
+    return flags;
+}
+
+/* Does what a status byte does to the message being received. Returns
+ * MIDIPARSE_SYSEX_CUT, MIDIPARSE_ABORTED, or 0 if there was none. */
+short midiparse_cut(MIDIPARSE *p)
+{
+    short expected = p->expected;
+
+    p->expected = 0;
+    if (expected == -1)
+	return MIDIPARSE_SYSEX_CUT;
+    return expected ? MIDIPARSE_ABORTED : 0;
+}
+
+/* Number of data bytes of a message, sysex excepted */
+short midiparse_data_length(UBYTE status)
+{
+    if (status >= 0xF0)
+	return status == 0xF2 ? 2 : status == 0xF6 ? 0 : 1;
+    if (status >= 0xC0 && status < 0xE0) /* Program change, channel pressure */
+	return 1;
+    return 2;
+}
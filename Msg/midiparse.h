@@ -0,0 +1,30 @@
+#ifndef MIDIPARSE_H
+#define MIDIPARSE_H
+
+/* Framing of a MIDI byte stream into messages. See midiparse.c. */
+
+#include "midimsg.h"
+
+/* What a byte does, midiparse_byte returns a combination of these */
+#define MIDIPARSE_REALTIME  0x01 /* It's a realtime message on its own */
+#define MIDIPARSE_ERROR     0x02 /* Unexpected data byte or EOX */
+#define MIDIPARSE_SYSEX_CUT 0x04 /* It's a status byte terminating a sysex */
+#define MIDIPARSE_ABORTED   0x08 /* It's a status byte cutting a message */
+#define MIDIPARSE_BEGIN     0x10 /* A message starts. If it's a data byte the
+				  * message uses running status. */
+#define MIDIPARSE_STORE     0x20 /* The byte belongs to the message */
+#define MIDIPARSE_END       0x40 /* The message is complete */
+
+/* Parser context, one per stream */
+typedef struct {
+    UBYTE status;	/* Status of the message being received */
+    UBYTE running;	/* Running status, 0 if none */
+    short expected;	/* Data bytes still expected, -1 for sysex, 0 if none */
+} MIDIPARSE;
+
+void midiparse_init(MIDIPARSE *p);
+short midiparse_byte(MIDIPARSE *p, UBYTE byte);
+short midiparse_cut(MIDIPARSE *p);
+short midiparse_data_length(UBYTE status);
+
+#endif
@@ -0,0 +1,370 @@
+/* This module follows a MIDI master: tempo and song position from the MIDI
+ * clock, start/continue/stop and song position messages, and time from the
+ * MIDI time code quarter frames.
+ *
+ * How to use: call midisync_init, then midisync_install to set the midimsg
+ * callbacks it needs (or call midisync_clock etc. from your own ones). Then
+ * at any time midisync_get gives a copy of what we know, and
+ * midisync_position where the song is at a given time.
+ *
+ * Tempo: the clocks are timestamped when they arrive (see midits.c) but
+ * they come with jitter, from the master and from the way we read them. A
+ * phase-locked loop (the usual second order one, as in a delay-locked loop)
+ * predicts when the next clock will come from the estimated time of the
+ * last one and the estimated period. The error of the prediction then
+ * corrects the time by error/2^shift and the period by error/2^(2*shift+1),
+ * which makes the loop critically damped. We start with shift=1 so the loop
+ * gets the tempo quickly, and narrow it as the clocks come until shift is
+ * MAX_SHIFT, which filters most of the jitter. The mean error of the
+ * predictions starts high and follows the jitter: we're locked when it's
+ * under 1ms (or 1/8 of the period), so with more jitter it takes longer,
+ * and with too much it never happens. A clock further than half a period
+ * from its prediction is ignored. If it's about a whole number of periods
+ * late, clocks may have been lost before it, or it may only be late: the
+ * next clock tells. If it's as late, the prediction and the song position
+ * move on by the clocks lost, else nothing changes. If the next clock is
+ * out of line anyway, the tempo changed or the clocks had stopped, and we
+ * start over. Times are kept in 1/16 so the small corrections aren't lost.
+ *
+ * Position: counted in clocks from the start of the song. Start resets it,
+ * song position moves it (a song position beat is 6 clocks), continue goes
+ * on from where it is. Between clocks, midisync_position moves it on at the
+ * estimated tempo but never past the next clock.
+ *
+ * MTC: a full time code takes 8 quarter frames, i.e. 2 frames. When the 8th
+ * arrives in sequence we have the time of the frame when the first one was
+ * sent, plus 7 quarter frames. Then each quarter frame moves the time code
+ * on by itself, and each complete sequence checks it. A quarter frame out of
+ * sequence (the tape was moved or goes backwards) makes it invalid until a
+ * new sequence is complete.
+ *
+ * The callbacks can run in an interrupt, or in another thread than the
+ * queries. The state is published with a sequence counter: it's odd while
+ * the state changes, so a reader which sees it odd, or changed after taking
+ * its copy, simply takes it again. Nobody ever waits for a lock and a query
+ * is a copy of a few bytes.
+ */
+
+#include "midisync.h"
+
+#ifdef __GNUC__
+#define BARRIER() __sync_synchronize()
+#else
+#define BARRIER() /* One 68000, which doesn't reorder memory accesses */
+#endif
+
+#define MAX_SHIFT 4	/* Narrowest loop: corrections of 1/16 and 1/512 */
+#define LOCK_ERROR 16000L /* Mean error under which we're locked, in 1/16 us */
+#define MAX_LOST 2	/* Clocks which may be lost in a row */
+#define MAX_PERIOD 250000L /* Longest time between clocks (10 BPM) */
+
+/* What readers get */
+static MIDISYNC_STATE shared;
+static volatile ULONG sequence;
+
+/* What we change */
+static MIDISYNC_STATE state;
+
+/* Clock tracking */
+static int have_clock;		/* A clock was received */
+static TIMESTAMP last_clock;	/* Time of the last clock received */
+static ULONG next;		/* Predicted time of the next clock, in 1/16 */
+static short clocks;		/* Clocks since the loop started, 0 if it's not
+				 * started. Stops at the narrowest loop. */
+static short shift;		/* Gain of the loop */
+static ULONG error_mean;	/* Mean absolute error of the predictions, in 1/16 */
+static int missed;		/* The last clock was out of line */
+static short maybe_lost;	/* Clocks lost before it if the next one is as late */
+static ULONG next_tick;		/* Song position of the next clock */
+
+/* MTC tracking */
+static UBYTE pieces[8];		/* Last value of each quarter frame type */
+static short in_sequence;	/* Number of quarter frames received in sequence */
+static UBYTE next_type;		/* Type of the quarter frame expected next */
+
+static void publish(void);
+static long labs_(long x);
+static void restart_loop(TIMESTAMP ts);
+static ULONG lock_error(void);
+static void next_frame(MIDISYNC_TIMECODE *tc);
+
+
+void midisync_init(void)
+{
+    state.running = state.ticking = state.locked = 0;
+    state.period = 0;
+    state.clock_time = 0;
+    state.tick = 0;
+    state.mtc_valid = 0;
+    state.quarter = 0;
+    state.mtc_time = 0;
+    have_clock = 0;
+    next_tick = 0;
+    in_sequence = 0;
+    publish();
+}
+
+void midisync_install(void)
+{
+    midimsg_callbacks.clock = midisync_clock;
+    midimsg_callbacks.song_start = midisync_start;
+    midimsg_callbacks.song_continue = midisync_continue;
+    midimsg_callbacks.song_stop = midisync_stop;
+    midimsg_callbacks.song_position = midisync_song_position;
+    midimsg_callbacks.mtc_quarter_frame = midisync_mtc_quarter_frame;
+}
+
+/* Gets a consistent copy of the state. Never blocks the callbacks. */
+void midisync_get(MIDISYNC_STATE *copy)
+{
+    ULONG before;
+
+    do {
+	before = sequence;
+	BARRIER();
+	*copy = shared;
+	BARRIER();
+    } while ((before & 1) || before != sequence);
+}
+
+/* Tempo in 1/100 of BPM, 0 if unknown. 24 clocks per quarter note, and the
+ * period is in 1/16 us: 60000000 * 16 * 100 / 24 = 4000000000. */
+ULONG midisync_tempo(const MIDISYNC_STATE *s)
+{
+    return s->period ? 4000000000UL / s->period : 0;
+}
+
+/* Song position at 'now', in 1/256 of clocks */
+ULONG midisync_position(const MIDISYNC_STATE *s, TIMESTAMP now)
+{
+    long elapsed;
+    ULONG fraction;
+
+    if (!s->ticking || !s->period)
+	return s->tick << 8;
+
+    elapsed = (long)(now - s->clock_time);
+    if (elapsed <= 0)
+	return s->tick << 8;
+    if ((ULONG)elapsed << 4 >= s->period) /* Wait for the next clock */
+	return (s->tick << 8) + 255;
+
+    /* elapsed < MAX_PERIOD < 2^18, no overflow */
+    fraction = ((ULONG)elapsed << 12) / s->period;
+    return (s->tick << 8) + fraction;
+}
+
+
+void midisync_clock(TIMESTAMP ts)
+{
+    ULONG t = ts << 4;
+    ULONG estimate;
+    long error, period;
+    short lost = 0;
+
+    if (!have_clock)
+    {
+	have_clock = 1;
+	clocks = 0;
+	state.clock_time = ts;
+    }
+    else if (clocks == 0)
+	restart_loop(ts);
+    else
+    {
+	error = (long)(t - next);
+	period = (long)state.period;
+
+	/* The last clock was out of line. If this one is as late, clocks were
+	 * lost before it, else it was only late (or early). */
+	if (missed && maybe_lost && labs_(error - maybe_lost * period) <= period >> 1)
+	{
+	    lost = maybe_lost;
+	    next += lost * state.period;
+	    error -= lost * period;
+	}
+
+	if (labs_(error) > period >> 1)
+	{
+	    if (missed || (long)(ts - last_clock) > MAX_PERIOD)
+	    {
+		/* Twice in a row, or after a pause: the tempo changed or the
+		 * clocks had stopped */
+		restart_loop(ts);
+	    }
+	    else
+	    {
+		/* One clock far from the others, take it as if it came when
+		 * it was expected and don't let it move the loop. If it's
+		 * about a whole number of periods late, the next one tells
+		 * whether clocks were lost. */
+		missed = 1;
+		maybe_lost = error > 0 ? (error + (period >> 1)) / period : 0;
+		if (maybe_lost > MAX_LOST || labs_(error - maybe_lost * period) > period >> 2)
+		    maybe_lost = 0;
+		state.clock_time = ts - ((long)(t - next) >> 4);
+		next += state.period;
+	    }
+	}
+	else
+	{
+	    /* Shifts of negative numbers are arithmetic with Pure C and gcc */
+	    estimate = next + (error >> shift);
+	    state.period += error >> (2 * shift + 1);
+	    next = estimate + state.period;
+	    state.clock_time = ts - ((long)(t - estimate) >> 4);
+	    missed = 0;
+
+	    error_mean += (labs_(error) - (long)error_mean) >> 4;
+	    if (shift < MAX_SHIFT && ++clocks >= (4 << shift))
+		shift++;
+	    /* Hysteresis, so jitter around the limit doesn't make it flicker */
+	    if (error_mean < lock_error())
+		state.locked = 1;
+	    else if (error_mean > 2 * lock_error())
+		state.locked = 0;
+	}
+    }
+    last_clock = ts;
+
+    if (state.running)
+    {
+	next_tick += lost;
+	state.tick = next_tick++;
+	state.ticking = 1;
+    }
+    publish();
+}
+
+void midisync_start(TIMESTAMP ts)
+{
+    next_tick = 0;
+    midisync_continue(ts);
+}
+
+void midisync_continue(TIMESTAMP ts)
+{
+    state.running = 1;
+    state.ticking = 0;
+    state.tick = next_tick;
+    publish();
+}
+
+void midisync_stop(TIMESTAMP ts)
+{
+    state.running = state.ticking = 0;
+    state.tick = next_tick;
+    publish();
+}
+
+void midisync_song_position(MIDIMSG_SONG_POSITION *pos)
+{
+    next_tick = (ULONG)pos->position * 6;
+    if (!state.ticking)
+	state.tick = next_tick;
+    publish();
+}
+
+void midisync_mtc_quarter_frame(MIDIMSG_MTC_QUARTER_FRAME *mtc)
+{
+    MIDISYNC_TIMECODE tc;
+
+    if (in_sequence && mtc->type != next_type)
+    {
+	in_sequence = 0;
+	state.mtc_valid = 0;
+    }
+    if (in_sequence < 8)
+	in_sequence++;
+    next_type = (mtc->type + 1) & 7;
+    pieces[mtc->type] = mtc->value;
+
+    if (state.mtc_valid && ++state.quarter == 4)
+    {
+	state.quarter = 0;
+	next_frame(&state.timecode);
+    }
+
+    if (mtc->type == 7 && in_sequence == 8)
+    {
+	tc.frames = pieces[0] | (pieces[1] & 1) << 4;
+	tc.seconds = pieces[2] | (pieces[3] & 3) << 4;
+	tc.minutes = pieces[4] | (pieces[5] & 3) << 4;
+	tc.hours = pieces[6] | (pieces[7] & 1) << 4;
+	tc.rate = (pieces[7] >> 1) & 3;
+	/* Frame of the first quarter frame, we're 7 quarter frames later */
+	next_frame(&tc);
+	state.timecode = tc;
+	state.quarter = 3;
+	state.mtc_valid = 1;
+    }
+    state.mtc_time = mtc->timestamp;
+    publish();
+}
+
+
+static void publish(void)
+{
+    sequence++;
+    BARRIER();
+    shared = state;
+    BARRIER();
+    sequence++;
+}
+
+/* Starts the loop again from the interval between the last two clocks. If
+ * it's too long the clocks had stopped, wait for the next one. */
+static void restart_loop(TIMESTAMP ts)
+{
+    if ((long)(ts - last_clock) > MAX_PERIOD || (long)(ts - last_clock) <= 0)
+    {
+	state.period = 0;
+	state.clock_time = ts;
+	state.locked = 0;
+	clocks = 0;
+	return;
+    }
+    state.period = (ts - last_clock) << 4;
+    state.clock_time = ts;
+    state.locked = 0;
+    next = (ts << 4) + state.period;
+    error_mean = state.period >> 2; /* Unknown, so well above lock_error */
+    missed = 0;
+    clocks = 1;
+    shift = 1;
+}
+
+static long labs_(long x)
+{
+    return x < 0 ? -x : x;
+}
+
+/* Mean error under which the tempo is trusted: 1ms, or 1/8 of the period if
+ * that's more so a slow master with the same jitter in proportion locks */
+static ULONG lock_error(void)
+{
+    ULONG limit = state.period >> 3;
+
+    return limit > LOCK_ERROR ? limit : LOCK_ERROR;
+}
+
+static void next_frame(MIDISYNC_TIMECODE *tc)
+{
+    static const UBYTE fps[] = { 24, 25, 30, 30 };
+
+    if (++tc->frames < fps[tc->rate])
+	return;
+    tc->frames = 0;
+    if (++tc->seconds < 60)
+	return;
+    tc->seconds = 0;
+    if (++tc->minutes == 60)
+    {
+	tc->minutes = 0;
+	if (++tc->hours == 24)
+	    tc->hours = 0;
+    }
+    /* Drop frame: frames 0 and 1 are skipped at each minute but every 10th */
+    if (tc->rate == MIDISYNC_30DF && tc->minutes % 10)
+	tc->frames = 2;
+}
@@ -0,0 +1,56 @@
+#ifndef MIDISYNC_H
+#define MIDISYNC_H
+
+/* Follows the MIDI clock, song position and MIDI time code received through
+ * midimsg. See midisync.c. */
+
+#include "midimsg.h"
+
+/* MTC frame rates */
+#define MIDISYNC_24FPS   0
+#define MIDISYNC_25FPS   1
+#define MIDISYNC_30DF    2	/* 29.97 drop frame */
+#define MIDISYNC_30FPS   3
+
+typedef struct {
+    UBYTE hours;
+    UBYTE minutes;
+    UBYTE seconds;
+    UBYTE frames;
+    UBYTE rate;		/* MIDISYNC_ frame rate */
+} MIDISYNC_TIMECODE;
+
+/* What we know about the master. Times are in the unit of the timestamps
+ * (microseconds with midits). */
+typedef struct {
+    /* MIDI clock */
+    UBYTE running;	/* Start or continue received, and no stop since */
+    UBYTE ticking;	/* Running and clocks received since */
+    UBYTE locked;	/* The tempo estimate has settled */
+    ULONG period;	/* Estimated time between clocks, in 1/16, 0 if unknown */
+    TIMESTAMP clock_time; /* Estimated time of the last clock */
+    ULONG tick;		/* Song position of the last clock, in clocks (24 per
+			 * quarter note). When not ticking, position of the
+			 * next one. */
+    /* MIDI time code */
+    UBYTE mtc_valid;	/* A full time code was received and it's going on */
+    UBYTE quarter;	/* Quarter frames since the start of the frame */
+    MIDISYNC_TIMECODE timecode; /* Frame at mtc_time */
+    TIMESTAMP mtc_time;	/* Time of the last quarter frame */
+} MIDISYNC_STATE;
+
+void midisync_init(void);
+void midisync_install(void);
+void midisync_get(MIDISYNC_STATE *state);
+ULONG midisync_tempo(const MIDISYNC_STATE *state);
+ULONG midisync_position(const MIDISYNC_STATE *state, TIMESTAMP now);
+
+/* midimsg callbacks, to call from the program's own callbacks if it has some */
+void midisync_clock(TIMESTAMP ts);
+void midisync_start(TIMESTAMP ts);
+void midisync_continue(TIMESTAMP ts);
+void midisync_stop(TIMESTAMP ts);
+void midisync_song_position(MIDIMSG_SONG_POSITION *pos);
+void midisync_mtc_quarter_frame(MIDIMSG_MTC_QUARTER_FRAME *mtc);
+
+#endif
@@ -0,0 +1,329 @@
+/* Tests for midisync: feeds midimsg with clock streams at several tempos
+ * and amounts of jitter and reports how long the tempo takes to lock and
+ * how far it is from the real one, and what a lost or late clock does. Also
+ * checks the song position and the MTC time code. */
+
+#include <stdio.h>
+
+#include "midisync.h"
+#include "miditest.h"
+
+#define N_CLOCKS 2000
+#define TIME_ORIGIN ((TIMESTAMP)0 - 0x100000) /* Timestamps wrap around during the test */
+
+/* Tempo error allowed once locked, in 1/100 of % */
+#define MAX_MEAN_ERROR 50
+#define MAX_LOCK_CLOCKS 200
+
+static long labs_(long x)
+{
+    return x < 0 ? -x : x;
+}
+
+/* Sends a clock stream. Returns 0 if it's fine. */
+static int clock_test(short bpm, short jitter)
+{
+    MIDISYNC_STATE s;
+    ULONG period = 2500000UL / bpm; /* us between clocks */
+    ULONG real = (ULONG)bpm * 100;
+    TIMESTAMP ts;
+    long error, error_sum = 0, error_max = 0;
+    short i, lock_in = -1, after = 0;
+    long position_error, position_max = 0;
+    ULONG expected;
+
+    midisync_init();
+    midimsg_process(0xFA, TIME_ORIGIN);
+    for (i = 0; i < N_CLOCKS; i++)
+    {
+	ts = TIME_ORIGIN + 1000 + i * period;
+	if (jitter)
+	    ts += miditest_rnd(2 * jitter + 1) - jitter;
+	midimsg_process(0xF8, ts);
+
+	midisync_get(&s);
+	if (!s.locked)
+	{
+	    lock_in = -1;
+	    continue;
+	}
+	if (lock_in < 0)
+	{
+	    lock_in = i;
+	    error_sum = error_max = position_max = 0;
+	    after = 0;
+	}
+	error = labs_((long)midisync_tempo(&s) - (long)real) * 10000 / real;
+	error_sum += error;
+	if (error > error_max)
+	    error_max = error;
+	after++;
+
+	/* Half way to the next clock, we should be half way through a clock */
+	expected = ((ULONG)i << 8) + 128;
+	position_error = labs_((long)(midisync_position(&s, TIME_ORIGIN + 1000 + i * period + period / 2) - expected));
+	if (position_error > position_max)
+	    position_max = position_error;
+    }
+
+    if (lock_in < 0)
+    {
+	printf("%3d BPM  %4dus  never locked  FAILED\n", bpm, jitter);
+	return 1;
+    }
+    printf("%3d BPM  %4dus  lock %3d clocks %5lums  tempo error mean %2ld.%02ld%% max %2ld.%02ld%%  position %3ld/256  %s\n",
+	   bpm, jitter, lock_in, lock_in * period / 1000,
+	   error_sum / after / 100, error_sum / after % 100, error_max / 100, error_max % 100,
+	   position_max, lock_in <= MAX_LOCK_CLOCKS && error_sum / after <= MAX_MEAN_ERROR ? "ok" : "FAILED");
+    return lock_in > MAX_LOCK_CLOCKS || error_sum / after > MAX_MEAN_ERROR;
+}
+
+/* The tempo changes, we should follow */
+static int tempo_change_test(void)
+{
+    MIDISYNC_STATE s;
+    TIMESTAMP ts = TIME_ORIGIN;
+    short i;
+    ULONG tempo;
+
+    midisync_init();
+    for (i = 0; i < 500; i++)
+    {
+	ts += 2500000UL / 120;
+	midimsg_process(0xF8, ts + miditest_rnd(1001) - 500);
+    }
+    for (i = 0; i < 500; i++)
+    {
+	ts += 2500000UL / 90;
+	midimsg_process(0xF8, ts + miditest_rnd(1001) - 500);
+    }
+    midisync_get(&s);
+    tempo = midisync_tempo(&s);
+    printf("120 -> 90 BPM : %lu.%02lu BPM  %s\n", tempo / 100, tempo % 100,
+	   s.locked && tempo > 8950 && tempo < 9050 ? "ok" : "FAILED");
+    return !(s.locked && tempo > 8950 && tempo < 9050);
+}
+
+/* Once locked, clocks are lost in a row, or one comes late (in % of the
+ * period): we should stay locked, on tempo, and count the clocks right */
+static int glitch_test(const char *what, short lost, short late)
+{
+    MIDISYNC_STATE s;
+    ULONG period = 2500000UL / 120;
+    TIMESTAMP ts;
+    ULONG tempo;
+    short i;
+    int failed = 0, locked = 0;
+
+    midisync_init();
+    midimsg_process(0xFA, TIME_ORIGIN);
+    for (i = 0; i < 600; i++)
+    {
+	ts = TIME_ORIGIN + 1000 + i * period + miditest_rnd(501) - 250;
+	if (i >= 300 && i < 300 + lost)
+	    continue;
+	if (i == 300)
+	    ts += (long)period * late / 100;
+	midimsg_process(0xF8, ts);
+
+	midisync_get(&s);
+	if (s.locked)
+	    locked = 1;
+	else if (locked)
+	    failed = 1;
+	/* After lost clocks, the next one tells they were lost */
+	failed |= s.tick != i && !(lost && i == 300 + lost);
+    }
+    tempo = midisync_tempo(&s);
+    failed |= !locked || tempo < 11950 || tempo > 12050;
+    printf("%-15s: %lu.%02lu BPM  %s\n", what, tempo / 100, tempo % 100,
+	   failed ? "FAILED" : "ok");
+    return failed;
+}
+
+/* A steady clock for longer than a short can count: we must stay locked */
+static int long_test(void)
+{
+    MIDISYNC_STATE s;
+    ULONG period = 2500000UL / 120;
+    TIMESTAMP ts = TIME_ORIGIN;
+    long i, unlocked = 0;
+    int locked = 0;
+
+    midisync_init();
+    for (i = 0; i < 140000L; i++)
+    {
+	ts += period;
+	midimsg_process(0xF8, ts);
+	midisync_get(&s);
+	if (s.locked)
+	    locked = 1;
+	else if (locked)
+	    unlocked++;
+    }
+    printf("140000 clocks  : %ld unlocked  %s\n", unlocked,
+	   locked && !unlocked ? "ok" : "FAILED");
+    return !locked || unlocked;
+}
+
+/* Song position, continue, stop */
+static int position_test(void)
+{
+    MIDISYNC_STATE s;
+    MIDIMSG_SONG_POSITION pos;
+    short i;
+    int failed = 0;
+
+    midisync_init();
+    midimsg_process(0xF2, 1);
+    midimsg_process(16, 2);	/* 16 + 2 * 128 = 272 beats */
+    midimsg_process(2, 3);
+    midisync_get(&s);
+    failed |= s.tick != 272 * 6 || s.running;
+
+    midimsg_process(0xFB, 10);	/* Continue */
+    for (i = 0; i < 10; i++)
+	midimsg_process(0xF8, 100 + i * 1000);
+    midisync_get(&s);
+    failed |= s.tick != 272 * 6 + 9 || !s.ticking;
+
+    midimsg_process(0xFC, 20000); /* Stop */
+    midisync_get(&s);
+    failed |= s.tick != 272 * 6 + 10 || s.running;
+    failed |= midisync_position(&s, 30000) != (272 * 6 + 10) << 8;
+
+    pos.timestamp = 0;
+    pos.position = 0;
+    midisync_song_position(&pos);
+    midimsg_process(0xFA, 40000); /* Start */
+    midimsg_process(0xF8, 41000);
+    midisync_get(&s);
+    failed |= s.tick != 0;
+
+    printf("Song position : %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+
+/* Time code of a frame number */
+static void timecode(ULONG n, UBYTE rate, MIDISYNC_TIMECODE *tc)
+{
+    static const UBYTE fps[] = { 24, 25, 30, 30 };
+    ULONG d, m;
+
+    if (rate == MIDISYNC_30DF)
+    {
+	/* 17982 frames per 10 minutes, 2 numbers dropped in 9 of them */
+	d = n / 17982;
+	m = n % 17982;
+	n += 18 * d + (m > 1 ? 2 * ((m - 2) / 1798) : 0);
+    }
+    tc->frames = n % fps[rate];
+    n /= fps[rate];
+    tc->seconds = n % 60;
+    n /= 60;
+    tc->minutes = n % 60;
+    tc->hours = (n / 60) % 24;
+    tc->rate = rate;
+}
+
+static int same_timecode(MIDISYNC_TIMECODE *a, MIDISYNC_TIMECODE *b)
+{
+    return a->hours == b->hours && a->minutes == b->minutes
+	&& a->seconds == b->seconds && a->frames == b->frames && a->rate == b->rate;
+}
+
+/* Sends quarter frames from a frame, checks the time code at each one */
+static int mtc_test(ULONG start, UBYTE rate, short frames)
+{
+    MIDISYNC_STATE s;
+    MIDISYNC_TIMECODE tc, expected;
+    UBYTE pieces[8];
+    short k, type;
+    int failed = 0;
+
+    midisync_init();
+    for (k = 0; k < frames * 4; k++)
+    {
+	type = k & 7;
+	if (type == 0)
+	{
+	    timecode(start + k / 4, rate, &tc);
+	    pieces[0] = tc.frames & 0x0f;
+	    pieces[1] = tc.frames >> 4;
+	    pieces[2] = tc.seconds & 0x0f;
+	    pieces[3] = tc.seconds >> 4;
+	    pieces[4] = tc.minutes & 0x0f;
+	    pieces[5] = tc.minutes >> 4;
+	    pieces[6] = tc.hours & 0x0f;
+	    pieces[7] = tc.hours >> 4 | rate << 1;
+	}
+	midimsg_process(0xF1, k);
+	midimsg_process(type << 4 | pieces[type], k);
+
+	midisync_get(&s);
+	if (k < 7)
+	{
+	    failed |= s.mtc_valid;
+	    continue;
+	}
+	timecode(start + k / 4, rate, &expected);
+	if (!s.mtc_valid || !same_timecode(&s.timecode, &expected) || s.quarter != (k & 3))
+	{
+	    printf("Quarter frame %d: got %02d:%02d:%02d:%02d.%d, expected %02d:%02d:%02d:%02d.%d\n",
+		   k, s.timecode.hours, s.timecode.minutes, s.timecode.seconds,
+		   s.timecode.frames, s.quarter, expected.hours, expected.minutes,
+		   expected.seconds, expected.frames, k & 3);
+	    return 1;
+	}
+    }
+
+    /* Out of sequence: invalid until a full sequence */
+    midimsg_process(0xF1, k);
+    midimsg_process(0x30, k);
+    midisync_get(&s);
+    failed |= s.mtc_valid;
+
+    timecode(start, rate, &expected);
+    printf("MTC from %02d:%02d:%02d:%02d rate %d : %s\n", expected.hours,
+	   expected.minutes, expected.seconds, expected.frames, rate,
+	   failed ? "FAILED" : "ok");
+    return failed;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const short tempos[] = { 40, 90, 120, 180, 250 };
+    static const short jitters[] = { 0, 250, 1000, 2000 };
+    UBYTE sysex_buffer[4];
+    short i, j;
+    int failed = 0;
+
+    midimsg_init(sysex_buffer, sizeof(sysex_buffer));
+    midisync_install();
+
+    for (i = 0; i < sizeof(tempos) / sizeof(tempos[0]); i++)
+	for (j = 0; j < sizeof(jitters) / sizeof(jitters[0]); j++)
+	    failed |= clock_test(tempos[i], jitters[j]);
+    failed |= tempo_change_test();
+    failed |= glitch_test("Clock lost", 1, 0);
+    failed |= glitch_test("2 clocks lost", 2, 0);
+    failed |= glitch_test("Late clock 60%", 0, 60);
+    failed |= glitch_test("Late clock 80%", 0, 80);
+    failed |= glitch_test("Late clock 90%", 0, 90);
+    failed |= glitch_test("Late clock 95%", 0, 95);
+    failed |= glitch_test("Early clock 60%", 0, -60);
+    failed |= long_test();
+    failed |= position_test();
+
+    failed |= mtc_test(24L * 3600 * 24 - 100, MIDISYNC_24FPS, 200);
+    failed |= mtc_test(25L * 60 - 20, MIDISYNC_25FPS, 100);
+    failed |= mtc_test(30L * 60 - 20, MIDISYNC_30FPS, 100);
+    failed |= mtc_test(1800 - 20, MIDISYNC_30DF, 100);	/* Frames dropped */
+    failed |= mtc_test(17982 - 20, MIDISYNC_30DF, 100);	/* 10th minute, none */
+
+    midimsg_exit();
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
@@ -0,0 +1,23 @@
+/* Helpers for the test programs: the same random numbers everywhere, so a
+ * failure can be reproduced, and a way to check that a module gives back
+ * all the messages it got. This is nothing Atari specific. */
+
+#include "miditest.h"
+
+unsigned long miditest_seed = 1;
+
+/* Random number from 0 to n-1 */
+unsigned short miditest_rnd(unsigned short n)
+{
+    miditest_seed = miditest_seed * 1103515245UL + 12345;
+    return (unsigned short)((miditest_seed >> 16) & 0x7fff) % n;
+}
+
+/* Counts a message. 'time' and 'end' are what the module under test gives
+ * with the message (timestamp, position, 0 if unused). */
+void miditest_sum(MIDITEST_SUM *s, UBYTE status, UBYTE d1, UBYTE d2,
+		  ULONG time, ULONG end)
+{
+    s->count++;
+    s->sum += ((unsigned long)status << 16 | d1 << 8 | d2) + time * 7 + end * 13;
+}
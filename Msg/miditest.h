@@ -0,0 +1,20 @@
+#ifndef MIDITEST_H
+#define MIDITEST_H
+
+/* What the test programs share. See miditest.c. */
+
+#include "midimsg.h"
+
+/* Messages counted with a sum which doesn't depend on their order */
+typedef struct {
+    unsigned long count;
+    unsigned long sum;
+} MIDITEST_SUM;
+
+extern unsigned long miditest_seed;
+
+unsigned short miditest_rnd(unsigned short n);
+void miditest_sum(MIDITEST_SUM *s, UBYTE status, UBYTE d1, UBYTE d2,
+		  ULONG time, ULONG end);
+
+#endif
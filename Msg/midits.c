@@ -0,0 +1,159 @@
+/* This module timestamps the MIDI bytes and passes them to midimsg_process.
+ * midimsg gives each message the timestamp of its first byte, so all we
+ * have to do is to give it the best estimate of when each byte arrived.
+ *
+ * The clock is in microseconds. On TOS we use the 200Hz counter and the
+ * current value of the MFP Timer C (which makes it tick) so we get a
+ * resolution of 26us. Elsewhere we use CLOCK_MONOTONIC.
+ *
+ * Bytes may be read one by one as they arrive (midits_byte), or by blocks
+ * (midits_block) when the program only polls the input from time to time.
+ * In that case the bytes of the block were received back to back at 31250
+ * bauds, the last one when the block was read, so we interpolate the time of
+ * the others from their position in the block.
+ */
+
+#include "midits.h"
+
+/* Timestamp of the last byte, so timestamps never go backwards */
+static TIMESTAMP last_ts;
+static int have_last_ts;
+
+/* Clock statistics */
+static MIDITS_STATS stats;
+static TIMESTAMP last_clock;
+static int have_last_clock;
+static long jitter16; /* Jitter * 16, to keep precision */
+
+static void stamp(UBYTE byte, TIMESTAMP ts);
+static void measure_clock(TIMESTAMP ts);
+
+
+#ifdef __TOS__
+
+#include <tos.h>
+
+#define HZ_200 ((volatile ULONG *)0x4BAL)
+#define MFP_TCDR ((volatile UBYTE *)0xFFFFFA23L)
+#define TIMERC_DATA 192 /* 2457600Hz / 64 / 192 = 200Hz */
+
+/* Must be called in supervisor mode */
+static long st_clock(void)
+{
+    ULONG ticks;
+    UBYTE count;
+
+    /* Read again if the 200Hz interrupt happened meanwhile */
+    do {
+	ticks = *HZ_200;
+	count = *MFP_TCDR;
+    } while (ticks != *HZ_200);
+
+    /* A Timer C count is 1/38400s, i.e. 625/24 us */
+    return ticks * 5000UL + ((TIMERC_DATA - count) * 625UL) / 24;
+}
+
+TIMESTAMP midits_now(void)
+{
+    return (TIMESTAMP)Supexec(st_clock);
+}
+
+#else
+
+#include <time.h>
+
+TIMESTAMP midits_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TIMESTAMP)(now.tv_sec * 1000000UL + now.tv_nsec / 1000);
+}
+
+#endif
+
+
+void midits_init(void)
+{
+    have_last_ts = 0;
+    stats.count = 0;
+    stats.last = 0;
+    stats.min = 0xffffffffUL;
+    stats.max = 0;
+    stats.jitter = 0;
+    have_last_clock = 0;
+    jitter16 = 0;
+}
+
+/* Process a byte which has just been received */
+void midits_byte(UBYTE byte)
+{
+    stamp(byte, midits_now());
+}
+
+/* Process a block of bytes, the last of which was received at the given
+ * time */
+void midits_block(UBYTE *bytes, short length, TIMESTAMP received)
+{
+    TIMESTAMP ts;
+    short i;
+
+    if (length <= 0)
+	return;
+
+    ts = received - (ULONG)(length - 1) * MIDITS_BYTE_TIME;
+    for (i = 0; i < length; i++)
+    {
+	stamp(bytes[i], ts);
+	ts += MIDITS_BYTE_TIME;
+    }
+}
+
+void midits_get_stats(MIDITS_STATS *s)
+{
+    *s = stats;
+    s->jitter = jitter16 >> 4;
+}
+
+static void stamp(UBYTE byte, TIMESTAMP ts)
+{
+    /* The interpolation may place the start of a block before the end of the
+     * previous one if we were late reading that one. Timestamps are compared
+     * as differences so they can wrap around. */
+    if (have_last_ts && (long)(ts - last_ts) < 0)
+	ts = last_ts;
+    last_ts = ts;
+    have_last_ts = 1;
+
+    if (byte == 0xF8)
+	measure_clock(ts);
+
+    midimsg_process(byte, ts);
+}
+
+static void measure_clock(TIMESTAMP ts)
+{
+    ULONG interval;
+    long deviation;
+
+    if (have_last_clock)
+    {
+	interval = ts - last_clock;
+	if (stats.count)
+	{
+	    /* Same estimator as RFC 3550: J += (|D| - J) / 16 */
+	    deviation = (long)(interval - stats.last);
+	    if (deviation < 0)
+		deviation = -deviation;
+	    jitter16 += deviation - ((jitter16 + 8) >> 4);
+	}
+	if (interval < stats.min)
+	    stats.min = interval;
+	if (interval > stats.max)
+	    stats.max = interval;
+	stats.last = interval;
+	stats.count++;
+    }
+    last_clock = ts;
+    have_last_clock = 1;
+}
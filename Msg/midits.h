@@ -0,0 +1,30 @@
+#ifndef MIDITS_H
+#define MIDITS_H
+
+/* Timestamping policy for MIDIMSG: gives midimsg_process the time at which
+ * each byte arrived on the wire, in microseconds. */
+
+#include "midimsg.h"
+
+/* Time to transmit a byte at 31250 bauds (start bit, 8 bits, stop bit), in
+ * microseconds */
+#define MIDITS_BYTE_TIME 320
+
+/* Statistics about the intervals between MIDI clocks (F8) received. A
+ * master sends them at a steady rate, so they tell how accurate the
+ * timestamps are. All values are in microseconds. */
+typedef struct {
+    ULONG count;	/* Number of intervals measured */
+    ULONG last;		/* Last interval */
+    ULONG min;		/* Shortest interval */
+    ULONG max;		/* Longest interval */
+    ULONG jitter;	/* Smoothed mean deviation between intervals */
+} MIDITS_STATS;
+
+void midits_init(void);
+TIMESTAMP midits_now(void);
+void midits_byte(UBYTE byte);
+void midits_block(UBYTE *bytes, short length, TIMESTAMP received);
+void midits_get_stats(MIDITS_STATS *stats);
+
+#endif
@@ -0,0 +1,155 @@
+/* Tests for midits: feeds blocks of bytes with known reception times and
+ * checks the timestamps midimsg gets, the clamping, the wrap around, the
+ * clock statistics and the resolution of the clock. */
+
+#include <stdio.h>
+
+#include "midits.h"
+
+static TIMESTAMP notes[64];
+static short n_notes;
+static int failed;
+
+static void note_on(MIDIMSG_NOTE_ON *msg) {
+    notes[n_notes++] = msg->timestamp;
+}
+
+static void clock(TIMESTAMP ts) {
+}
+
+static void check(const char *what, int ok)
+{
+    printf("%-32s: %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok)
+	failed = 1;
+}
+
+/* The bytes of a block were received back to back, the last one at the time
+ * given */
+static void interpolation_test(void)
+{
+    static UBYTE block[] = { 0x90, 0x3C, 0x40, 0x3E, 0x40, 0xF8, 0x40, 0x40 };
+
+    midits_init();
+    n_notes = 0;
+    midits_block(block, sizeof(block), 10000);
+    /* Notes start at bytes 0, 3 and 6 (running status, clock in between) */
+    check("Interpolation", n_notes == 3 && notes[0] == 10000 - 7 * MIDITS_BYTE_TIME
+	  && notes[1] == 10000 - 4 * MIDITS_BYTE_TIME
+	  && notes[2] == 10000 - MIDITS_BYTE_TIME);
+}
+
+/* A block read late looks like it started before the end of the previous
+ * one, timestamps must not go backwards */
+static void clamp_test(void)
+{
+    static UBYTE first[] = { 0x90, 0x3C, 0x40 };
+    static UBYTE late[] = { 0x90, 0x30, 0x40, 0x31, 0x40, 0x32, 0x40, 0x33, 0x40, 0x34, 0x40 };
+    static const TIMESTAMP expected[] = { 9360, 10000, 10000, 10000, 10040, 10680 };
+    short i;
+    int ok;
+
+    midits_init();
+    n_notes = 0;
+    midits_block(first, sizeof(first), 10000);
+    midits_block(late, sizeof(late), 11000);
+    /* The late block starts at 11000 - 10 * 320 = 7800, until 10000 its
+     * bytes get the time of the last byte of the first block */
+    ok = n_notes == 6;
+    for (i = 0; i < n_notes && ok; i++)
+	ok = notes[i] == expected[i];
+    for (i = 1; i < n_notes; i++)
+	ok &= (long)(notes[i] - notes[i - 1]) >= 0;
+    check("No going backwards", ok);
+}
+
+/* The clock wraps around (after 71 minutes on TOS) */
+static void wrap_test(void)
+{
+    static UBYTE block[] = { 0x90, 0x3C, 0x40, 0x3E, 0x40 };
+
+    midits_init();
+    n_notes = 0;
+    midits_block(block, sizeof(block), (TIMESTAMP)0 - 0x1000);
+    midits_block(block, sizeof(block), 0x300); /* Starts before 0 */
+    check("Wrap around", n_notes == 4 && notes[2] == (TIMESTAMP)0x300 - 4 * MIDITS_BYTE_TIME
+	  && notes[3] == (TIMESTAMP)0x300 - MIDITS_BYTE_TIME);
+}
+
+/* Clock statistics against the same estimator computed here */
+static void stats_test(void)
+{
+    static const short offsets[] = { 0, 500, -500, 0, 250, -1000, 0, 300 };
+    static UBYTE f8 = 0xF8;
+    MIDITS_STATS stats;
+    TIMESTAMP ts, last = 0;
+    ULONG interval, last_interval = 0, min = 0xffffffffUL, max = 0;
+    double jitter = 0, d;
+    short i;
+
+    midits_init();
+    for (i = 0; i < 200; i++)
+    {
+	ts = (TIMESTAMP)0 - 0x100000 + i * 20000UL + offsets[i % 8];
+	midits_block(&f8, 1, ts);
+	if (i)
+	{
+	    interval = ts - last;
+	    if (i > 1)
+	    {
+		d = (double)interval - (double)last_interval;
+		jitter += ((d < 0 ? -d : d) - jitter) / 16;
+	    }
+	    if (interval < min)
+		min = interval;
+	    if (interval > max)
+		max = interval;
+	    last_interval = interval;
+	}
+	last = ts;
+    }
+    midits_get_stats(&stats);
+    printf("Clocks: %lu min:%luus max:%luus jitter:%luus (%.1fus)\n",
+	   stats.count, stats.min, stats.max, stats.jitter, jitter);
+    check("Clock statistics", stats.count == 199 && stats.min == min && stats.max == max
+	  && stats.last == last_interval
+	  && stats.jitter >= (ULONG)jitter - 1 && stats.jitter <= (ULONG)jitter + 1);
+}
+
+/* The clock must resolve less than a MIDI byte */
+static void resolution_test(void)
+{
+    TIMESTAMP t0, t1, step = 0xffffffffUL;
+    short i;
+
+    for (i = 0; i < 100; i++)
+    {
+	t0 = midits_now();
+	while ((t1 = midits_now()) == t0)
+	    ;
+	if (t1 - t0 < step)
+	    step = t1 - t0;
+    }
+    printf("Clock resolution: %luus\n", step);
+    check("Resolution below a byte time", step < MIDITS_BYTE_TIME);
+}
+
+
+int main(int argc, char *argv[])
+{
+    UBYTE sysex_buffer[4];
+
+    midimsg_init(sysex_buffer, sizeof(sysex_buffer));
+    midimsg_callbacks.note_on = note_on;
+    midimsg_callbacks.clock = clock;
+
+    interpolation_test();
+    clamp_test();
+    wrap_test();
+    stats_test();
+    resolution_test();
+
+    midimsg_exit();
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
@@ -4,6 +4,8 @@
 #include <tos.h>
 
 #include "midimsg.h"
+#include "midits.h"
+#include "midisync.h"
 
 static void midi_error(short code) {
 	switch (code) {
@@ -53,18 +55,22 @@ static void pitchbend(MIDIMSG_PITCH_BEND *msg) {
 /* System realtime message */
 static void clock(TIMESTAMP ts) {
 	printf("%04lu Clock\n",ts);
+	midisync_clock(ts);
 }
 
 static void song_start(TIMESTAMP ts) {
 	printf("%04lu Song start\n", ts);
+	midisync_start(ts);
 }
 
 static void song_continue(TIMESTAMP ts) {
 	printf("%04lu Song continue\n", ts);
+	midisync_continue(ts);
 }
 
 static void song_stop(TIMESTAMP ts) {
 	printf("%04lu Song stop\n", ts);
+	midisync_stop(ts);
 }
 
 static void active_sensing(TIMESTAMP ts) {
@@ -88,11 +94,13 @@ static void system_exclusive(MIDIMSG_SYSEX *sysex) {
 static void mtc_quarter_frame(MIDIMSG_MTC_QUARTER_FRAME *mtc)
 {
 	printf("%04lu MTC 1/4 frame: T:%d V:%d\n", mtc->timestamp, mtc->type, mtc->value);
+	midisync_mtc_quarter_frame(mtc);
 }
 
 static void song_position(MIDIMSG_SONG_POSITION *pos)
 {
 	printf("%04lu Song position: %4x\n", pos->timestamp, pos->position);
+	midisync_song_position(pos);
 }
 
 static void song_select(MIDIMSG_SONG_SELECT *song)
@@ -140,8 +148,11 @@ int main(int argc, char *argv[]) {
 	};
 	
 	UBYTE sysex_buffer[10];
+	UBYTE block[64];
 	short i;
 	TIMESTAMP ts;
+	MIDITS_STATS stats;
+	MIDISYNC_STATE sync;
 	(void)argc;
 	(void)argv;
 
@@ -186,13 +197,28 @@ int main(int argc, char *argv[]) {
 	Cconws("Press a key to start monitoring MIDI input.\r\n");
 	Cnecin();
 	Cconws("\33EMonitoring MIDI input. Press a key to exit !\r\n");
+	midits_init();
+	midisync_init();
 	while (!Cconis()) {
-		if (Bconstat(3)) {
-			short b = Bconin(3) & 0xff;
-			midimsg_process(b, ++ts);
-		}
+		/* Read what's arrived since last time, midits works out the
+		 * time each byte was received. */
+		for (i=0; i<sizeof(block) && Bconstat(3); i++)
+			block[i] = Bconin(3) & 0xff;
+		if (i)
+			midits_block(block, i, midits_now());
 	}
 
+	midits_get_stats(&stats);
+	if (stats.count)
+		printf("Clock intervals: %lu min:%luus max:%luus jitter:%luus\n",
+			stats.count, stats.min, stats.max, stats.jitter);
+	midisync_get(&sync);
+	printf("Tempo: %lu/100 BPM%s, position: %lu clocks\n",
+		midisync_tempo(&sync), sync.locked ? " (locked)" : "", sync.tick);
+	if (sync.mtc_valid)
+		printf("MTC: %02d:%02d:%02d:%02d\n", sync.timecode.hours,
+			sync.timecode.minutes, sync.timecode.seconds, sync.timecode.frames);
+
 	midimsg_exit();
     
 	Cconws("Press a key.");